@@ -3,15 +3,19 @@
 
 #include <stdint.h> 
 
-typedef void* va_list;
+// the compiler knows where the arguments are, also for 64 bit types
+typedef __builtin_va_list va_list;
 
 #define va_start(list, param) \
-    (list = (va_list) ((int32_t*)&param + 1))
+    __builtin_va_start(list, param)
 
-#define va_arg(list, type)   \
-     (*(type*) ((int32_t*)(list = (int32_t*)list + 1) - 1))
+#define va_arg(list, type) \
+    __builtin_va_arg(list, type)
+
+#define va_copy(dst, src) \
+    __builtin_va_copy(dst, src)
 
 #define va_end(list) \
-    (list = 0)
+    __builtin_va_end(list)
 
 #endif //STDARG_H
@@ -1,10 +1,12 @@
 #ifndef INTTYPES_H
 #define INTTYPES_H
 
+typedef unsigned long long uint64_t;
 typedef unsigned int uint32_t;
 typedef unsigned short uint16_t;
 typedef unsigned char uint8_t;
 
+typedef long long int64_t;
 typedef int int32_t;
 typedef short int16_t;
 typedef char int8_t;
@@ -0,0 +1,10 @@
+#ifndef STDIO_H
+#define STDIO_H
+
+#include <stdint.h>
+#include <stdarg.h>
+
+int vsnprintf(char* output, size_t size, const char* fmt, va_list va);
+int snprintf(char* output, size_t size, const char* fmt, ...);
+
+#endif //STDIO_H
@@ -7,4 +7,15 @@ void* memset(void* ptr, int byte, size_t size);
 
 void* memcpy(void* dst, const void* src, size_t size);
 
+void* memmove(void* dst, const void* src, size_t size);
+
+int memcmp(const void* ptr0, const void* ptr1, size_t size);
+
+size_t strlen(const char* str);
+int strcmp(const char* str0, const char* str1);
+
+// whole 4 KiB pages, page aligned, picked at boot from cpuid
+extern void (*copy_page)(void* dst, const void* src);
+extern void (*clear_page)(void* page);
+
 #endif //STRING_H
@@ -5,6 +5,27 @@
 #define sti() __asm__ __volatile__("sti")
 #define hlt() __asm__ __volatile__("hlt")
 
+static inline uint64_t rdtsc() {
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void invlpg(uint32_t address) {
+    __asm__ __volatile__ ("invlpg (%0)" : : "r"(address) : "memory");
+}
+
+// disable interrupts, returning the previous eflags for irq_restore
+static inline uint32_t irq_save() {
+    uint32_t flags;
+    __asm__ __volatile__ ("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    __asm__ __volatile__ ("pushl %0; popfl" : : "r"(flags) : "memory", "cc");
+}
+
 //out %ax, port
 //out %ax, %dx
 
@@ -41,5 +62,30 @@ static inline uint32_t inl(uint16_t port) {
     return value;
 }
 
+//rep insw/outsw, count words between a port and memory
+
+static inline void insw(uint16_t port, void* buffer, uint32_t count) {
+    __asm__ __volatile__ ("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buffer, uint32_t count) {
+    __asm__ __volatile__ ("rep outsw" : "+S"(buffer), "+c"(count) : "d"(port));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    __asm__ __volatile__ ("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf));
+}
+
+//wrmsr %edx:%eax, %ecx
+//rdmsr %ecx, %edx:%eax
+
+static inline void wrmsr(uint32_t msr, uint32_t low, uint32_t high) {
+    __asm__ __volatile__ ("wrmsr" : : "c"(msr), "a"(low), "d"(high));
+}
+
+static inline void rdmsr(uint32_t msr, uint32_t* low, uint32_t* high) {
+    __asm__ __volatile__ ("rdmsr" : "=a"(*low), "=d"(*high) : "c"(msr));
+}
+
 #endif //ASM_H
 
@@ -0,0 +1,367 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "block.h"
+#include "pci.h"
+#include "interrupt.h"
+#include "asm.h"
+#include "kernel.h"
+
+// primary channel, master drive
+#define ATA_IO           0x1f0
+#define ATA_CONTROL      0x3f6
+#define ATA_IRQ          (IRQ0 + 14)
+
+#define ATA_DATA         (ATA_IO + 0)
+#define ATA_ERROR        (ATA_IO + 1)
+#define ATA_COUNT        (ATA_IO + 2)
+#define ATA_LBA0         (ATA_IO + 3)
+#define ATA_LBA1         (ATA_IO + 4)
+#define ATA_LBA2         (ATA_IO + 5)
+#define ATA_DRIVE        (ATA_IO + 6)
+#define ATA_STATUS       (ATA_IO + 7)
+#define ATA_COMMAND      (ATA_IO + 7)
+
+#define STATUS_ERR       0x01
+#define STATUS_DRQ       0x08
+#define STATUS_DF        0x20
+#define STATUS_BSY       0x80
+
+#define CONTROL_NIEN     0x02
+
+#define DRIVE_LBA        0xe0
+
+#define CMD_READ_PIO     0x20
+#define CMD_WRITE_PIO    0x30
+#define CMD_READ_DMA     0xc8
+#define CMD_WRITE_DMA    0xca
+#define CMD_IDENTIFY     0xec
+
+// bus master ide, the primary channel registers at the start of bar4
+#define BM_COMMAND       0
+#define BM_STATUS        2
+#define BM_PRDT          4
+
+#define BM_START         0x01
+#define BM_TO_MEMORY     0x08
+#define BM_ACTIVE        0x01
+#define BM_ERROR         0x02
+#define BM_INTERRUPT     0x04
+
+#define PRD_END          0x80000000
+#define ATA_PRDS         32
+
+// the count register holds 256 as 0
+#define ATA_MAX_SECTORS  256
+
+/*
+ * physical region descriptor, a piece of the transfer that doesn't cross a
+ * 64K boundary. The kernel identity maps memory, so kernel addresses are
+ * physical addresses.
+ */
+struct prd_t {
+    uint32_t address;
+    uint32_t size; // 0 means 64K, PRD_END on the last one
+} __attribute__((packed));
+
+/*
+ * requests wait in a list sorted by sector and the drive serves them
+ * going up from where the last batch ended, wrapping to the lowest
+ * sector (c-scan). A batch is a request plus the ones that follow it on
+ * disk in the same direction, done as one command with a descriptor per
+ * buffer (or per sector for pio).
+ */
+static struct {
+    struct block_request_t* queue;
+    struct block_request_t* batch;
+    uint32_t batch_sectors;
+    uint32_t position;
+
+    uint16_t bus_master;
+    struct prd_t prds[ATA_PRDS] __attribute__((aligned(8)));
+
+    // pio progress in the batch
+    struct block_request_t* pio_request;
+    uint32_t pio_sector;
+} ata;
+
+static struct block_device_t ata_device = {
+    .name = "hda",
+    .max_count = ATA_MAX_SECTORS,
+};
+
+static int wait_ready() {
+    uint8_t status;
+
+    while((status = inb(ATA_STATUS)) & STATUS_BSY)
+        ;
+
+    return status;
+}
+
+static uint32_t prd_count(uint32_t address, uint32_t size) {
+    uint32_t first = address >> 16;
+    uint32_t last = (address + size - 1) >> 16;
+    return last - first + 1;
+}
+
+static int build_prds(struct block_request_t* batch) {
+    int count = 0;
+
+    for(struct block_request_t* request = batch; request; request = request->next) {
+        uint32_t address = (uint32_t)request->buffer;
+        uint32_t size = request->count * SECTOR_SIZE;
+
+        while(size > 0) {
+            uint32_t piece = 0x10000 - (address & 0xffff);
+            if(piece > size)
+                piece = size;
+
+            ata.prds[count].address = address;
+            ata.prds[count].size = piece & 0xffff;
+            count++;
+
+            address += piece;
+            size -= piece;
+        }
+    }
+
+    ata.prds[count - 1].size |= PRD_END;
+    return count;
+}
+
+// take the next batch off the queue, requests stay linked through next
+static struct block_request_t* pick_batch() {
+    struct block_request_t** link = &ata.queue;
+
+    while(*link && (*link)->sector < ata.position)
+        link = &(*link)->next;
+
+    if(!*link)
+        link = &ata.queue;
+
+    struct block_request_t* first = *link;
+    struct block_request_t* last = first;
+    uint32_t sectors = first->count;
+    uint32_t prds = prd_count((uint32_t)first->buffer, first->count * SECTOR_SIZE);
+
+    while(last->next) {
+        struct block_request_t* next = last->next;
+        uint32_t next_prds = prd_count((uint32_t)next->buffer, next->count * SECTOR_SIZE);
+
+        if(next->sector != last->sector + last->count || next->write != first->write)
+            break;
+
+        if(sectors + next->count > ATA_MAX_SECTORS || prds + next_prds > ATA_PRDS)
+            break;
+
+        sectors += next->count;
+        prds += next_prds;
+        last = next;
+    }
+
+    *link = last->next;
+    last->next = 0;
+
+    ata.batch_sectors = sectors;
+    return first;
+}
+
+static void ata_start() {
+    if(ata.batch || !ata.queue)
+        return;
+
+    struct block_request_t* batch = pick_batch();
+    uint32_t sector = batch->sector;
+    int write = batch->write;
+
+    ata.batch = batch;
+
+    if(ata.bus_master) {
+        build_prds(batch);
+
+        outb(ata.bus_master + BM_COMMAND, 0);
+        outb(ata.bus_master + BM_STATUS, BM_ERROR | BM_INTERRUPT);
+        outl(ata.bus_master + BM_PRDT, (uint32_t)ata.prds);
+        outb(ata.bus_master + BM_COMMAND, write ? 0 : BM_TO_MEMORY);
+    }
+
+    wait_ready();
+    outb(ATA_DRIVE, DRIVE_LBA | ((sector >> 24) & 0x0f));
+    outb(ATA_COUNT, ata.batch_sectors & 0xff);
+    outb(ATA_LBA0, sector & 0xff);
+    outb(ATA_LBA1, (sector >> 8) & 0xff);
+    outb(ATA_LBA2, (sector >> 16) & 0xff);
+
+    if(ata.bus_master) {
+        outb(ATA_COMMAND, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+        outb(ata.bus_master + BM_COMMAND, (write ? 0 : BM_TO_MEMORY) | BM_START);
+        return;
+    }
+
+    ata.pio_request = batch;
+    ata.pio_sector = 0;
+    outb(ATA_COMMAND, write ? CMD_WRITE_PIO : CMD_READ_PIO);
+
+    // the drive asks for the first sector of a write, the rest on interrupts
+    if(write) {
+        while((wait_ready() & (STATUS_DRQ | STATUS_ERR)) == 0)
+            ;
+
+        outsw(ATA_DATA, batch->buffer, SECTOR_SIZE / 2);
+        ata.pio_sector = 1;
+    }
+}
+
+static void finish_batch(int error) {
+    struct block_request_t* request = ata.batch;
+
+    ata.position = request->sector + ata.batch_sectors;
+    ata.batch = 0;
+
+    while(request) {
+        struct block_request_t* next = request->next;
+        block_complete(request, error);
+        request = next;
+    }
+
+    ata_start();
+}
+
+// pio moves a sector per interrupt, returns 1 when the batch is done
+static int pio_transfer() {
+    struct block_request_t* request = ata.pio_request;
+
+    if(ata.pio_sector == request->count) {
+        request = ata.pio_request = request->next;
+        ata.pio_sector = 0;
+    }
+
+    if(!request)
+        return 1;
+
+    uint8_t* buffer = (uint8_t*)request->buffer + ata.pio_sector * SECTOR_SIZE;
+
+    if(request->write)
+        outsw(ATA_DATA, buffer, SECTOR_SIZE / 2);
+    else
+        insw(ATA_DATA, buffer, SECTOR_SIZE / 2);
+
+    ata.pio_sector++;
+
+    // the interrupt after the last written sector completes the batch
+    return !request->write && !request->next && ata.pio_sector == request->count;
+}
+
+static void ata_interrupt() {
+    if(!ata.batch) {
+        inb(ATA_STATUS);
+        return;
+    }
+
+    if(ata.bus_master) {
+        uint8_t bm_status = inb(ata.bus_master + BM_STATUS);
+
+        outb(ata.bus_master + BM_COMMAND, 0);
+        uint8_t status = inb(ATA_STATUS);
+        outb(ata.bus_master + BM_STATUS, BM_ERROR | BM_INTERRUPT);
+
+        finish_batch((status & (STATUS_ERR | STATUS_DF)) || (bm_status & BM_ERROR));
+        return;
+    }
+
+    uint8_t status = inb(ATA_STATUS);
+
+    if(status & (STATUS_ERR | STATUS_DF)) {
+        finish_batch(1);
+        return;
+    }
+
+    if(pio_transfer())
+        finish_batch(0);
+}
+
+static void ata_submit(struct block_device_t* device, struct block_request_t* request) {
+    uint32_t flags = irq_save();
+    struct block_request_t** link = &ata.queue;
+
+    while(*link && (*link)->sector <= request->sector)
+        link = &(*link)->next;
+
+    request->next = *link;
+    *link = request;
+
+    ata_start();
+    irq_restore(flags);
+}
+
+static int ata_identify() {
+    uint16_t identify[256];
+
+    outb(ATA_DRIVE, 0xa0);
+    if(inb(ATA_STATUS) == 0xff)
+        return -1;
+
+    outb(ATA_COUNT, 0);
+    outb(ATA_LBA0, 0);
+    outb(ATA_LBA1, 0);
+    outb(ATA_LBA2, 0);
+    outb(ATA_COMMAND, CMD_IDENTIFY);
+
+    if(inb(ATA_STATUS) == 0)
+        return -1;
+
+    wait_ready();
+
+    // atapi and sata signatures
+    if(inb(ATA_LBA1) || inb(ATA_LBA2))
+        return -1;
+
+    uint8_t status;
+    while(!((status = inb(ATA_STATUS)) & (STATUS_DRQ | STATUS_ERR)))
+        ;
+
+    if(status & STATUS_ERR)
+        return -1;
+
+    insw(ATA_DATA, identify, 256);
+
+    ata_device.sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    return 0;
+}
+
+static void ata_find_bus_master() {
+    pci_device_t device = pci_find_class(0x01, 0x01);
+
+    if(device == PCI_NONE)
+        return;
+
+    uint32_t bar = pci_read(device, PCI_BAR4);
+    if(!(bar & PCI_BAR_IO))
+        return;
+
+    uint32_t command = pci_read(device, PCI_COMMAND);
+    pci_write(device, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+    ata.bus_master = bar & 0xfffc;
+}
+
+void init_ata() {
+    outb(ATA_CONTROL, CONTROL_NIEN);
+
+    if(ata_identify() < 0 || ata_device.sectors == 0)
+        return;
+
+    ata_find_bus_master();
+
+    ata_device.submit = ata_submit;
+    ata_device.data = &ata;
+    register_block_device(&ata_device);
+
+    register_interrupt_handler(ATA_IRQ, &ata_interrupt);
+    enable_irq(IRQ0 + 2);
+    enable_irq(ATA_IRQ);
+    outb(ATA_CONTROL, 0);
+
+    kprintf("hda: %d sectors, %s\n", ata_device.sectors, ata.bus_master ? "dma" : "pio");
+}
@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "block.h"
+#include "task.h"
+#include "asm.h"
+
+static struct block_device_t* block_devices[BLOCK_DEVICES];
+
+int register_block_device(struct block_device_t* device) {
+    for(int i = 0; i < BLOCK_DEVICES; i++) {
+        if(!block_devices[i]) {
+            block_devices[i] = device;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+struct block_device_t* find_block_device(const char* name) {
+    for(int i = 0; i < BLOCK_DEVICES; i++) {
+        if(block_devices[i] && strcmp(block_devices[i]->name, name) == 0)
+            return block_devices[i];
+    }
+
+    return 0;
+}
+
+void block_submit(struct block_device_t* device, struct block_request_t* request) {
+    request->done = 0;
+    request->wait.head = 0;
+    request->wait.tail = 0;
+    request->next = 0;
+
+    if(request->sector + request->count > device->sectors || request->count == 0 ||
+       request->count > device->max_count) {
+        block_complete(request, 1);
+        return;
+    }
+
+    device->submit(device, request);
+}
+
+// drivers call this, usually from their irq handler
+void block_complete(struct block_request_t* request, int error) {
+    request->done = error ? -1 : 1;
+    wake_up(&request->wait);
+}
+
+int block_wait(struct block_request_t* request) {
+    uint32_t flags = irq_save();
+
+    while(!request->done)
+        sleep_on(&request->wait);
+
+    irq_restore(flags);
+    return request->done > 0 ? 0 : -1;
+}
+
+// split into requests the driver takes
+static int block_transfer(struct block_device_t* device, uint32_t sector, uint32_t count,
+                          void* buffer, int write) {
+    struct block_request_t request;
+
+    while(count) {
+        request.sector = sector;
+        request.count = count < device->max_count ? count : device->max_count;
+        request.buffer = buffer;
+        request.write = write;
+
+        block_submit(device, &request);
+        if(block_wait(&request) < 0)
+            return -1;
+
+        sector += request.count;
+        count -= request.count;
+        buffer = (uint8_t*)buffer + request.count * SECTOR_SIZE;
+    }
+
+    return 0;
+}
+
+int block_read(struct block_device_t* device, uint32_t sector, uint32_t count, void* buffer) {
+    return block_transfer(device, sector, count, buffer, 0);
+}
+
+int block_write(struct block_device_t* device, uint32_t sector, uint32_t count, const void* buffer) {
+    return block_transfer(device, sector, count, (void*)buffer, 1);
+}
@@ -0,0 +1,44 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "task.h"
+
+#define SECTOR_SIZE 512
+
+#define BLOCK_DEVICES 4
+
+/*
+ * a transfer of whole sectors to or from a buffer in identity mapped
+ * kernel memory (drivers may hand it to dma as is). done is 0 while it is
+ * in flight, 1 when it finished and -1 on an error, the submitter may
+ * compute meanwhile and block_wait() when it needs the data.
+ */
+struct block_request_t {
+    uint32_t sector;
+    uint32_t count;
+    void* buffer;
+    int write;
+    volatile int done;
+    struct wait_queue_t wait;
+    struct block_request_t* next;
+};
+
+struct block_device_t {
+    const char* name;
+    uint32_t sectors;
+    uint32_t max_count; // the most sectors one request may move
+    void (*submit)(struct block_device_t* device, struct block_request_t* request);
+    void* data;
+};
+
+int register_block_device(struct block_device_t* device);
+struct block_device_t* find_block_device(const char* name);
+
+void block_submit(struct block_device_t* device, struct block_request_t* request);
+void block_complete(struct block_request_t* request, int error);
+int block_wait(struct block_request_t* request);
+
+int block_read(struct block_device_t* device, uint32_t sector, uint32_t count, void* buffer);
+int block_write(struct block_device_t* device, uint32_t sector, uint32_t count, const void* buffer);
+
+#endif //BLOCK_H
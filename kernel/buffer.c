@@ -0,0 +1,329 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "paging.h"
+#include "heap.h"
+#include "task.h"
+#include "asm.h"
+#include "kernel.h"
+
+// seconds between write-back passes
+#define FLUSH_INTERVAL 5
+
+/*
+ * buffer cache
+ *
+ * buffers are hashed by (device, block) and kept on one lru list, most
+ * recently released first. A new block takes the least recently used
+ * buffer nobody holds, the cache grows a frame (PAGE_SIZE / BUFFER_SIZE
+ * buffers) at a time up to BUFFER_MAX. Writes only mark the buffer dirty,
+ * a kernel thread writes dirty buffers back. Reading the block after the
+ * one read last starts reading the next BUFFER_READAHEAD blocks in the
+ * background, the driver merges them into one transfer.
+ *
+ * the lists are only touched with interrupts disabled.
+ */
+
+static struct buffer_t* buffer_hash[BUFFER_HASH];
+static struct buffer_t* lru_head;
+static struct buffer_t* lru_tail;
+static int buffer_count;
+
+static struct block_device_t* last_device;
+static uint32_t last_block;
+
+static inline uint32_t hash(struct block_device_t* device, uint32_t block) {
+    return (((uint32_t)device >> 4) + block) % BUFFER_HASH;
+}
+
+static void lru_remove(struct buffer_t* buffer) {
+    if(buffer->lru_prev)
+        buffer->lru_prev->lru_next = buffer->lru_next;
+    else
+        lru_head = buffer->lru_next;
+
+    if(buffer->lru_next)
+        buffer->lru_next->lru_prev = buffer->lru_prev;
+    else
+        lru_tail = buffer->lru_prev;
+}
+
+static void lru_push(struct buffer_t* buffer) {
+    buffer->lru_prev = 0;
+    buffer->lru_next = lru_head;
+
+    if(lru_head)
+        lru_head->lru_prev = buffer;
+    else
+        lru_tail = buffer;
+
+    lru_head = buffer;
+}
+
+static void hash_remove(struct buffer_t* buffer) {
+    struct buffer_t** link = &buffer_hash[hash(buffer->device, buffer->block)];
+
+    while(*link != buffer)
+        link = &(*link)->hash_next;
+
+    *link = buffer->hash_next;
+}
+
+static struct buffer_t* lookup(struct block_device_t* device, uint32_t block) {
+    struct buffer_t* buffer = buffer_hash[hash(device, block)];
+
+    while(buffer && (buffer->device != device || buffer->block != block))
+        buffer = buffer->hash_next;
+
+    return buffer;
+}
+
+// carve a frame into buffers
+static int grow() {
+    if(buffer_count >= BUFFER_MAX)
+        return -1;
+
+    uint8_t* frame = (uint8_t*)alloc_frame();
+    struct buffer_t* buffers = (struct buffer_t*)kmalloc(sizeof(struct buffer_t) * (PAGE_SIZE / BUFFER_SIZE));
+
+    if(!frame || !buffers) {
+        if(frame)
+            put_frame((uint32_t)frame);
+        kfree(buffers);
+        return -1;
+    }
+
+    memset(buffers, 0, sizeof(struct buffer_t) * (PAGE_SIZE / BUFFER_SIZE));
+
+    for(int i = 0; i < PAGE_SIZE / BUFFER_SIZE; i++) {
+        buffers[i].data = frame + i * BUFFER_SIZE;
+        lru_push(&buffers[i]);
+        buffer_count++;
+    }
+
+    return 0;
+}
+
+// finish a request the buffer has in flight, sleeping if needed
+static void buffer_wait(struct buffer_t* buffer) {
+    if(!(buffer->flags & BUFFER_BUSY))
+        return;
+
+    int error = block_wait(&buffer->request);
+    buffer->flags &= ~BUFFER_BUSY;
+
+    if(buffer->request.write) {
+        if(error)
+            buffer->flags |= BUFFER_DIRTY;
+    } else if(!error) {
+        buffer->flags |= BUFFER_VALID;
+    }
+}
+
+static void start_write(struct buffer_t* buffer) {
+    buffer->flags &= ~BUFFER_DIRTY;
+    buffer->flags |= BUFFER_BUSY;
+    buffer->request.sector = buffer->block;
+    buffer->request.count = 1;
+    buffer->request.buffer = buffer->data;
+    buffer->request.write = 1;
+    block_submit(buffer->device, &buffer->request);
+}
+
+static void start_read(struct buffer_t* buffer) {
+    buffer->flags |= BUFFER_BUSY;
+    buffer->request.sector = buffer->block;
+    buffer->request.count = 1;
+    buffer->request.buffer = buffer->data;
+    buffer->request.write = 0;
+    block_submit(buffer->device, &buffer->request);
+}
+
+static struct buffer_t* find_unused() {
+    for(struct buffer_t* buffer = lru_tail; buffer; buffer = buffer->lru_prev) {
+        if(!buffer->refs && !(buffer->flags & (BUFFER_DIRTY | BUFFER_BUSY)))
+            return buffer;
+    }
+
+    return 0;
+}
+
+// write back the dirty buffers nobody holds, returns how many were waited on
+static int flush_unused() {
+    struct buffer_t* buffer;
+    int count = 0;
+
+    for(buffer = lru_tail; buffer; buffer = buffer->lru_prev) {
+        if(!buffer->refs && (buffer->flags & (BUFFER_DIRTY | BUFFER_BUSY)) == BUFFER_DIRTY)
+            start_write(buffer);
+    }
+
+    for(buffer = lru_tail; buffer; buffer = buffer->lru_prev) {
+        if(!buffer->refs && (buffer->flags & BUFFER_BUSY)) {
+            buffer_wait(buffer);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// a clean buffer nobody holds, from the cold end of the lru
+static struct buffer_t* evict() {
+    struct buffer_t* buffer;
+
+    while(!(buffer = find_unused())) {
+        if(grow() == 0)
+            continue;
+
+        if(!flush_unused())
+            return 0;
+    }
+
+    if(buffer->device)
+        hash_remove(buffer);
+
+    return buffer;
+}
+
+// the buffer for a block, held and possibly not read yet
+static struct buffer_t* get_buffer(struct block_device_t* device, uint32_t block) {
+    struct buffer_t* buffer = lookup(device, block);
+
+    if(!buffer) {
+        if(!(buffer = evict()))
+            return 0;
+
+        // evict may have slept and another task hashed the block meanwhile
+        struct buffer_t* other = lookup(device, block);
+
+        if(other) {
+            // the evicted one stays on the lru, unhashed and free
+            buffer->device = 0;
+            buffer->flags = 0;
+            buffer = other;
+        } else {
+            buffer->device = device;
+            buffer->block = block;
+            buffer->flags = 0;
+
+            uint32_t index = hash(device, block);
+            buffer->hash_next = buffer_hash[index];
+            buffer_hash[index] = buffer;
+        }
+    }
+
+    buffer->refs++;
+    lru_remove(buffer);
+    lru_push(buffer);
+    return buffer;
+}
+
+struct buffer_t* getblk(struct block_device_t* device, uint32_t block) {
+    uint32_t flags = irq_save();
+    struct buffer_t* buffer = get_buffer(device, block);
+
+    if(buffer)
+        buffer_wait(buffer);
+
+    irq_restore(flags);
+    return buffer;
+}
+
+static void read_ahead(struct block_device_t* device, uint32_t block) {
+    for(uint32_t next = block + 1; next <= block + BUFFER_READAHEAD && next < device->sectors; next++) {
+        if(lookup(device, next))
+            continue;
+
+        struct buffer_t* buffer = get_buffer(device, next);
+        if(!buffer)
+            break;
+
+        start_read(buffer);
+        buffer->refs--;
+    }
+}
+
+struct buffer_t* bread(struct block_device_t* device, uint32_t block) {
+    uint32_t flags = irq_save();
+    struct buffer_t* buffer = get_buffer(device, block);
+
+    if(!buffer) {
+        irq_restore(flags);
+        return 0;
+    }
+
+    if(!(buffer->flags & (BUFFER_VALID | BUFFER_BUSY)))
+        start_read(buffer);
+
+    if(device == last_device && block == last_block + 1)
+        read_ahead(device, block);
+
+    last_device = device;
+    last_block = block;
+
+    buffer_wait(buffer);
+
+    if(!(buffer->flags & BUFFER_VALID)) {
+        buffer->refs--;
+        buffer = 0;
+    }
+
+    irq_restore(flags);
+    return buffer;
+}
+
+void bdirty(struct buffer_t* buffer) {
+    buffer->flags |= BUFFER_VALID | BUFFER_DIRTY;
+}
+
+void brelse(struct buffer_t* buffer) {
+    if(!buffer)
+        return;
+
+    uint32_t flags = irq_save();
+    buffer->refs--;
+    irq_restore(flags);
+}
+
+/*
+ * write every dirty buffer back and wait for it. One still being written
+ * goes with the next sync. Waiting sleeps and the lru changes meanwhile,
+ * so the walk starts over from the head after each wait.
+ */
+void buffer_sync() {
+    uint32_t flags = irq_save();
+    struct buffer_t* buffer;
+
+    for(buffer = lru_head; buffer; buffer = buffer->lru_next) {
+        if((buffer->flags & (BUFFER_DIRTY | BUFFER_BUSY)) == BUFFER_DIRTY)
+            start_write(buffer);
+    }
+
+    buffer = lru_head;
+
+    while(buffer) {
+        if(buffer->flags & BUFFER_BUSY) {
+            buffer_wait(buffer);
+            buffer = lru_head;
+        } else {
+            buffer = buffer->lru_next;
+        }
+    }
+
+    irq_restore(flags);
+}
+
+static int buffer_flusher(void* arg) {
+    while(1) {
+        sleep_ticks(FLUSH_INTERVAL * TIMER_FREQUENCY);
+        buffer_sync();
+    }
+
+    return 0;
+}
+
+void init_buffer_cache() {
+    kthread_create(&buffer_flusher, 0);
+}
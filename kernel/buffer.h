@@ -0,0 +1,34 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "block.h"
+
+// a buffer caches one sector
+#define BUFFER_SIZE      SECTOR_SIZE
+#define BUFFER_MAX       1024
+#define BUFFER_HASH      128
+#define BUFFER_READAHEAD 8
+
+#define BUFFER_VALID (1 << 0) // data matches the disk or is newer
+#define BUFFER_DIRTY (1 << 1) // newer than the disk
+#define BUFFER_BUSY  (1 << 2) // request in flight
+
+struct buffer_t {
+    struct block_device_t* device;
+    uint32_t block;
+    uint8_t* data;
+    int flags;
+    int refs;
+    struct block_request_t request;
+    struct buffer_t* hash_next;
+    struct buffer_t* lru_prev;
+    struct buffer_t* lru_next;
+};
+
+struct buffer_t* bread(struct block_device_t* device, uint32_t block);
+struct buffer_t* getblk(struct block_device_t* device, uint32_t block);
+void bdirty(struct buffer_t* buffer);
+void brelse(struct buffer_t* buffer);
+void buffer_sync();
+
+#endif //BUFFER_H
@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "console.h"
+#include "interrupt.h"
+#include "softirq.h"
+#include "serial.h"
+#include "keyboard.h"
+#include "file.h"
+#include "asm.h"
+#include "kernel.h"
+
+#define VIDEO_WIDTH  80
+#define VIDEO_HEIGHT 25
+#define VIDEO_TAB    8
+#define VIDEO_BLANK  (0x0f00 | ' ')
+
+#define CRTC_INDEX   0x3d4
+#define CRTC_DATA    0x3d5
+
+/*
+ * kprintf only appends to the log ring. console_flush() renders what is new
+ * into a shadow of the screen and copies the changed lines to video memory,
+ * then moves the cursor once. The shadow rows are circular so scrolling
+ * doesn't move any text, it only marks every line dirty.
+ */
+
+static char log_buffer[LOG_SIZE];
+static volatile uint32_t log_head;   // total bytes logged
+static uint32_t log_rendered;        // bytes already on the shadow screen
+static uint32_t log_sent;            // bytes already queued on the serial line
+
+static int console_sinks = CONSOLE_VGA | CONSOLE_SERIAL;
+
+static uint16_t* const video_memory = (uint16_t*)0xb8000;
+static uint16_t shadow[VIDEO_HEIGHT][VIDEO_WIDTH];
+static int shadow_top;               // shadow row shown on the first line
+static uint32_t shadow_dirty;        // a bit per screen line
+static int cursor_x, cursor_y;
+static int cursor_moved;
+
+static uint16_t* screen_line(int y) {
+    return shadow[(shadow_top + y) % VIDEO_HEIGHT];
+}
+
+static void scroll() {
+    shadow_top = (shadow_top + 1) % VIDEO_HEIGHT;
+
+    uint16_t* last = screen_line(VIDEO_HEIGHT - 1);
+    for(int x = 0; x < VIDEO_WIDTH; x++)
+        last[x] = VIDEO_BLANK;
+
+    shadow_dirty = (1 << VIDEO_HEIGHT) - 1;
+    cursor_y--;
+}
+
+static void render(char ch) {
+    if(ch == 0x08 && cursor_x > 0) {
+        cursor_x--;
+    } else if(ch == 0x09) {
+        cursor_x = (cursor_x + VIDEO_TAB) & ~(VIDEO_TAB - 1);
+    } else if(ch == '\r') {
+        cursor_x = 0;
+    } else if(ch == '\n') {
+        cursor_x = 0;
+        cursor_y++;
+    } else {
+        screen_line(cursor_y)[cursor_x] = 0x0f00 | (uint8_t)ch;
+        shadow_dirty |= 1 << cursor_y;
+        cursor_x++;
+    }
+
+    if(cursor_x >= VIDEO_WIDTH) {
+        cursor_x = 0;
+        cursor_y++;
+    }
+
+    if(cursor_y >= VIDEO_HEIGHT)
+        scroll();
+
+    cursor_moved = 1;
+}
+
+static void move_cursor() {
+    uint16_t location = cursor_y * VIDEO_WIDTH + cursor_x;
+
+    outb(CRTC_INDEX, 14);
+    outb(CRTC_DATA, location >> 8);
+    outb(CRTC_INDEX, 15);
+    outb(CRTC_DATA, location & 0xff);
+}
+
+// the serial driver takes the new log bytes in at most two pieces
+static void flush_serial(uint32_t head) {
+    if(head - log_sent > LOG_SIZE)
+        log_sent = head - LOG_SIZE;
+
+    while(log_sent != head) {
+        uint32_t offset = log_sent & (LOG_SIZE - 1);
+        uint32_t count = head - log_sent;
+
+        if(count > LOG_SIZE - offset)
+            count = LOG_SIZE - offset;
+
+        serial_write(log_buffer + offset, count);
+        log_sent += count;
+    }
+}
+
+void console_flush() {
+    uint32_t flags = irq_save();
+    uint32_t head = log_head;
+
+    if(console_sinks & CONSOLE_SERIAL)
+        flush_serial(head);
+    else
+        log_sent = head;
+
+    if(!(console_sinks & CONSOLE_VGA))
+        log_rendered = head;
+
+    // the ring wrapped over text that was never shown
+    if(head - log_rendered > LOG_SIZE)
+        log_rendered = head - LOG_SIZE;
+
+    while(log_rendered != head)
+        render(log_buffer[log_rendered++ & (LOG_SIZE - 1)]);
+
+    for(int y = 0; shadow_dirty; y++, shadow_dirty >>= 1) {
+        if(shadow_dirty & 1)
+            memcpy(video_memory + y * VIDEO_WIDTH, screen_line(y), VIDEO_WIDTH * sizeof(uint16_t));
+    }
+
+    if(cursor_moved) {
+        move_cursor();
+        cursor_moved = 0;
+    }
+
+    irq_restore(flags);
+}
+
+// from irq context the screen is updated on the way out, in the softirq
+void console_write(const char* buffer, size_t size) {
+    uint32_t flags = irq_save();
+
+    for(size_t i = 0; i < size; i++)
+        log_buffer[log_head++ & (LOG_SIZE - 1)] = buffer[i];
+
+    irq_restore(flags);
+
+    if(in_irq())
+        raise_softirq(SOFTIRQ_CONSOLE);
+    else
+        console_flush();
+}
+
+// a sink only gets what is logged after it is selected
+void console_select(int sinks) {
+    uint32_t flags = irq_save();
+
+    console_flush();
+    console_sinks = sinks;
+
+    irq_restore(flags);
+}
+
+static int console_file_read(struct file_t* file, void* buffer, size_t size) {
+    return keyboard_read((char*)buffer, size);
+}
+
+static int console_file_write(struct file_t* file, const void* buffer, size_t size) {
+    console_write((const char*)buffer, size);
+    return size;
+}
+
+static const struct file_ops_t console_ops = {
+    .read = console_file_read,
+    .write = console_file_write,
+};
+
+// the console as descriptors 0, 1 and 2 of the current task, children
+// inherit them through fork
+void open_console() {
+    struct file_t* file = alloc_file(&console_ops, 0, FILE_READ | FILE_WRITE);
+
+    if(!file)
+        return;
+
+    for(int fd = 0; fd < 3; fd++) {
+        if(fd > 0)
+            file_get(file);
+
+        install_file(file);
+    }
+}
+
+// copy out the newest bytes of the log, like dmesg
+size_t log_read(char* buffer, size_t size) {
+    uint32_t flags = irq_save();
+    uint32_t head = log_head;
+    uint32_t available = head < LOG_SIZE ? head : LOG_SIZE;
+
+    if(size > available)
+        size = available;
+
+    for(uint32_t i = head - size; i != head; i++)
+        *buffer++ = log_buffer[i & (LOG_SIZE - 1)];
+
+    irq_restore(flags);
+    return size;
+}
+
+// keep what the bios left on the screen
+void init_console() {
+    memcpy(shadow, video_memory, sizeof(shadow));
+    open_softirq(SOFTIRQ_CONSOLE, &console_flush);
+}
@@ -0,0 +1,17 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// kernel log ring, must be a power of two
+#define LOG_SIZE 16384
+
+// console_select sinks
+#define CONSOLE_VGA    (1 << 0)
+#define CONSOLE_SERIAL (1 << 1)
+
+void console_write(const char* buffer, size_t size);
+void console_select(int sinks);
+void open_console();
+void console_flush();
+size_t log_read(char* buffer, size_t size);
+
+#endif //CONSOLE_H
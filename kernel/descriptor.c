@@ -2,7 +2,11 @@
 #include <string.h>
 
 #include "asm.h"
+#include "task.h"
+#include "stack.h"
+#include "serial.h"
 #include "global.h"
+#include "kernel.h"
 
 //access flags
 #define ACCESSED    (1 << 0)
@@ -74,9 +78,16 @@ struct table_pointer_t {
     uint32_t address;
 } __attribute__((packed));
 
-static struct gdt_descriptor_t gdt_table[6];
+#define DOUBLE_FAULT_STACK_SIZE 4096
+
+static struct gdt_descriptor_t gdt_table[7];
 static struct idt_descriptor_t idt_table[256];
 static struct tss_descriptor_t tss_entry;
+static struct tss_descriptor_t double_fault_tss;
+static uint8_t double_fault_stack[DOUBLE_FAULT_STACK_SIZE] __attribute__((aligned(16)));
+
+// esp0 of the running task, also read by the sysenter entry in trap.S
+uint32_t kernel_stack_top = 0;
 
 static void set_gdt_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t granularity) {
     gdt_table[index].base_low = base & 0xffff;
@@ -126,11 +137,14 @@ static void init_idt() {
 
     for(int i = 0; i < 256; i++)
         set_idt_entry(i, trap_vector[i], 0x08, 0x8e);
+
+    // int $0x80 from ring 3, dpl 3
+    set_idt_entry(0x80, trap_vector[0x80], 0x08, 0xee);
 }
 
 static void init_tss() {
     uint32_t base = (uint32_t)&tss_entry;
-    tss_segment(5, base, base+sizeof(struct tss_descriptor_t), 0);
+    tss_segment(5, base, sizeof(struct tss_descriptor_t) - 1, 0);
 
     memset(&tss_entry, 0, sizeof(struct tss_descriptor_t));
 
@@ -146,10 +160,63 @@ static void init_tss() {
     tss_entry.gs = 0x10 | 0x3;
 }
 
+/*
+ * a double fault (typically the kernel running into a stack guard page, the
+ * cpu can't push the page fault frame) switches through a task gate to its
+ * own tss and stack. The state of the faulting code is in tss_entry.
+ */
+static void double_fault() {
+    uint32_t esp = tss_entry.esp;
+
+    kprintf("double fault at eip 0x%x esp 0x%x", tss_entry.eip, esp);
+
+    if(is_stack_guard(esp - 4))
+        kprintf(", kernel stack overflow in pid %d", current_task->pid);
+
+    kprintf("\n");
+    serial_sync();
+
+    while(1)
+        hlt();
+}
+
+static void init_double_fault_tss() {
+    uint32_t base = (uint32_t)&double_fault_tss;
+    tss_segment(6, base, sizeof(struct tss_descriptor_t) - 1, 0);
+
+    memset(&double_fault_tss, 0, sizeof(struct tss_descriptor_t));
+
+    double_fault_tss.eip = (uint32_t)double_fault;
+    double_fault_tss.esp = (uint32_t)double_fault_stack + DOUBLE_FAULT_STACK_SIZE;
+    double_fault_tss.eflags = 0x2;
+    double_fault_tss.cs = 0x08;
+    double_fault_tss.ss =
+    double_fault_tss.es =
+    double_fault_tss.ds =
+    double_fault_tss.fs =
+    double_fault_tss.gs = 0x10;
+    double_fault_tss.iomap = sizeof(struct tss_descriptor_t);
+
+    //task gate, present, dpl 0
+    set_idt_entry(8, 0, 0x30, 0x85);
+}
+
+// the task gate loads cr3 from the tss, set once paging is up
+void set_double_fault_directory(uint32_t directory) {
+    double_fault_tss.cr3 = directory;
+}
+
+// called on every task switch, used on the next ring 3 -> ring 0 transition
+void set_kernel_stack(uint32_t esp0) {
+    tss_entry.esp0 = esp0;
+    kernel_stack_top = esp0;
+}
+
 void init_descriptor() {
     init_gdt();
     init_idt();
     init_tss();
+    init_double_fault_tss();
 
     struct table_pointer_t gdt_ptr; 
     gdt_ptr.limit = sizeof(gdt_table) - 1;
@@ -0,0 +1,48 @@
+#ifndef ELF_H
+#define ELF_H
+
+#define ELF_MAGIC   0x464c457f // "\x7fELF"
+#define ELF_CLASS32 1
+#define ELF_DATA2LSB 1
+#define ELF_EXEC    2
+#define ELF_386     3
+
+#define PT_LOAD     1
+
+#define PF_X        0x1
+#define PF_W        0x2
+#define PF_R        0x4
+
+struct elf_header_t {
+    uint32_t magic;
+    uint8_t  class;
+    uint8_t  data;
+    uint8_t  version;
+    uint8_t  pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t elf_version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed));
+
+struct elf_program_header_t {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed));
+
+#endif //ELF_H
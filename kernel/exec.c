@@ -0,0 +1,289 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "exec.h"
+#include "elf.h"
+#include "vfs.h"
+#include "paging.h"
+#include "task.h"
+#include "fpu.h"
+#include "ring.h"
+#include "heap.h"
+#include "global.h"
+
+/*
+ * program loading
+ *
+ * exec only reads the elf headers. Every PT_LOAD segment and the stack
+ * become vmas and their pages are filled in by the page fault handler on
+ * first touch. Read-only pages map the page cache frame itself, so every
+ * process running a program shares one copy of its text. Writable pages
+ * get a private copy of the file contents, zeroed past the end of the
+ * file part.
+ */
+
+static struct vma_t* alloc_vma(struct vma_t** list, uint32_t start, uint32_t end, int flags) {
+    struct vma_t* vma = (struct vma_t*)kmalloc(sizeof(struct vma_t));
+
+    if(vma) {
+        memset(vma, 0, sizeof(struct vma_t));
+        vma->start = start;
+        vma->end = end;
+        vma->flags = flags;
+        vma->next = *list;
+        *list = vma;
+    }
+
+    return vma;
+}
+
+static void free_vma_list(struct vma_t* vma) {
+    while(vma) {
+        struct vma_t* next = vma->next;
+        kfree(vma);
+        vma = next;
+    }
+}
+
+void free_vmas(struct task_t* task) {
+    free_vma_list(task->vmas);
+    task->vmas = 0;
+}
+
+void copy_vmas(struct task_t* task, struct task_t* from) {
+    struct vma_t** link = &task->vmas;
+
+    for(struct vma_t* vma = from->vmas; vma; vma = vma->next) {
+        struct vma_t* copy = (struct vma_t*)kmalloc(sizeof(struct vma_t));
+
+        if(!copy)
+            break;
+
+        *copy = *vma;
+        copy->next = 0;
+        *link = copy;
+        link = &copy->next;
+    }
+}
+
+static struct vma_t* find_vma(uint32_t address) {
+    struct vma_t* vma = current_task->vmas;
+
+    while(vma && (address < vma->start || address >= vma->end))
+        vma = vma->next;
+
+    return vma;
+}
+
+int vma_fault(uint32_t address) {
+    struct vma_t* vma = find_vma(address);
+    uint32_t page = address & ~(PAGE_SIZE - 1);
+    uint32_t frame;
+    int flags = 0;
+
+    if(!vma)
+        return -1;
+
+    if(vma->inode && page < vma->file_end) {
+        uint32_t cached = vfs_get_page(vma->inode, (vma->offset + page - vma->start) / PAGE_SIZE);
+
+        if(!cached)
+            return -1;
+
+        if(!(vma->flags & VMA_WRITE)) {
+            frame = cached;
+            flags = MAP_READONLY;
+        } else if((frame = alloc_frame())) {
+            uint32_t count = vma->file_end - page < PAGE_SIZE ? vma->file_end - page : PAGE_SIZE;
+
+            memcpy((void*)frame, (void*)cached, count);
+            memset((uint8_t*)frame + count, 0, PAGE_SIZE - count);
+            put_frame(cached);
+        } else {
+            put_frame(cached);
+            return -1;
+        }
+    } else {
+        if(!(frame = alloc_frame()))
+            return -1;
+
+        memset((void*)frame, 0, PAGE_SIZE);
+
+        if(!(vma->flags & VMA_WRITE))
+            flags = MAP_READONLY;
+    }
+
+    // another thread of the process may have mapped it while we slept
+    if(map_frame(current_directory, page, frame, flags) < 0 && !is_page_present(current_directory, page)) {
+        put_frame(frame);
+        return -1;
+    }
+
+    put_frame(frame);
+    return 0;
+}
+
+/*
+ * whether a system call may write size bytes at address for the current
+ * task. Mapped pages go by their page table entry, the rest by the vma
+ * that fills them in on first touch.
+ */
+int user_writable(uint32_t address, size_t size) {
+    if(!size)
+        return 1;
+
+    if(address + size < address)
+        return 0;
+
+    uint32_t last = (address + size - 1) & ~(PAGE_SIZE - 1);
+
+    for(uint32_t page = address & ~(PAGE_SIZE - 1); ; page += PAGE_SIZE) {
+        if(is_page_present(current_directory, page)) {
+            if(!is_page_writable(current_directory, page))
+                return 0;
+        } else {
+            struct vma_t* vma = find_vma(page);
+
+            if(!vma || !(vma->flags & VMA_WRITE))
+                return 0;
+        }
+
+        if(page == last)
+            return 1;
+    }
+}
+
+static int add_segment(struct vma_t** vmas, struct inode_t* inode, const struct elf_program_header_t* header) {
+    uint32_t start = header->vaddr & ~(PAGE_SIZE - 1);
+    uint32_t end = header->vaddr + header->memsz;
+
+    if(header->filesz > header->memsz || (header->vaddr - header->offset) % PAGE_SIZE ||
+       header->vaddr < USER_START || end < header->vaddr || end > USER_STACK_TOP - USER_STACK_SIZE ||
+       header->offset + header->filesz < header->offset || header->offset + header->filesz > inode->size)
+        return -1;
+
+    struct vma_t* vma = alloc_vma(vmas, start, (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1),
+                                  (header->flags & PF_W) ? VMA_WRITE : 0);
+
+    if(!vma)
+        return -1;
+
+    vma->inode = inode;
+    vma->offset = header->offset - (header->vaddr - start);
+    vma->file_end = header->vaddr + header->filesz;
+    return 0;
+}
+
+// the headers have to fit in the first page of the file
+static int load_elf(struct inode_t* inode, struct vma_t** vmas, uint32_t* entry) {
+    uint32_t frame = vfs_get_page(inode, 0);
+    int result = -1;
+
+    if(!frame)
+        return -1;
+
+    struct elf_header_t* header = (struct elf_header_t*)frame;
+
+    if(inode->size >= sizeof(struct elf_header_t) && header->magic == ELF_MAGIC &&
+       header->class == ELF_CLASS32 && header->data == ELF_DATA2LSB && header->type == ELF_EXEC &&
+       header->machine == ELF_386 && header->phentsize == sizeof(struct elf_program_header_t) &&
+       header->phoff <= PAGE_SIZE &&
+       header->phoff + header->phnum * sizeof(struct elf_program_header_t) <= PAGE_SIZE) {
+        struct elf_program_header_t* program = (struct elf_program_header_t*)(frame + header->phoff);
+
+        result = 0;
+        *entry = header->entry;
+
+        for(int i = 0; i < header->phnum && result == 0; i++) {
+            if(program[i].type == PT_LOAD && program[i].memsz)
+                result = add_segment(vmas, inode, &program[i]);
+        }
+    }
+
+    put_frame(frame);
+    return result;
+}
+
+/*
+ * the top page of the new stack, in a frame not mapped yet: the argument
+ * strings, argv[] and a call frame for _start(argc, argv), which must
+ * exit instead of returning
+ */
+static int build_stack(uint32_t frame, char* const* argv, uint32_t* esp) {
+    uint8_t* page = (uint8_t*)frame;
+    uint32_t base = USER_STACK_TOP - PAGE_SIZE;
+    uint32_t top = PAGE_SIZE;
+    uint32_t pointers[EXEC_ARGS];
+    int argc = 0;
+
+    for(; argv && argv[argc]; argc++) {
+        size_t length = strlen(argv[argc]) + 1;
+
+        // leave room for argv[] and the call frame
+        if(argc == EXEC_ARGS || length + (EXEC_ARGS + 4) * sizeof(uint32_t) > top)
+            return -1;
+
+        top -= length;
+        memcpy(page + top, argv[argc], length);
+        pointers[argc] = base + top;
+    }
+
+    uint32_t* stack = (uint32_t*)(page + (top & ~3));
+
+    *--stack = 0;
+    for(int i = argc; i > 0; i--)
+        *--stack = pointers[i - 1];
+
+    uint32_t user_argv = base + ((uint8_t*)stack - page);
+    *--stack = user_argv;
+    *--stack = argc;
+    *--stack = 0;
+
+    *esp = base + ((uint8_t*)stack - page);
+    return 0;
+}
+
+// exec(path, argv), replaces the address space and returns to ring 3
+void system_exec() {
+    struct trap_t* trap = current_task->trap;
+    struct inode_t* inode = vfs_lookup((const char*)trap->ebx);
+    struct vma_t* vmas = 0;
+    uint32_t frame = 0;
+    uint32_t entry;
+    uint32_t esp;
+
+    // nothing of the caller is touched until the program is known to load
+    if(!inode || inode->type != VFS_FILE || load_elf(inode, &vmas, &entry) < 0 ||
+       !alloc_vma(&vmas, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP, VMA_WRITE) ||
+       !(frame = alloc_frame()) || build_stack(frame, (char* const*)trap->esi, &esp) < 0) {
+        free_vma_list(vmas);
+        if(frame)
+            put_frame(frame);
+        trap->eax = -1;
+        return;
+    }
+
+    struct pde_t* directory = clone_page_directory(kernel_directory);
+
+    ring_release(current_task);
+    free_vmas(current_task);
+    current_task->vmas = vmas;
+    set_task_directory(current_task, directory);
+    fpu_release(current_task);
+
+    map_frame(directory, USER_STACK_TOP - PAGE_SIZE, frame, 0);
+    put_frame(frame);
+
+    /*
+     * a ring 0 caller's frame has no user_esp and ss, setting them writes
+     * over its stack, which is gone anyway. trap_end or sysexit then
+     * return to ring 3.
+     */
+    memset(trap, 0, sizeof(struct trap_t));
+    trap->ds = USER_DS;
+    trap->eip = entry;
+    trap->cs = USER_CS;
+    trap->eflags = 0x202;
+    trap->user_esp = esp;
+    trap->ss = USER_DS;
+}
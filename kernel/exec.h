@@ -0,0 +1,37 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#define USER_START      0x40000000 // programs are linked above the kernel identity map
+#define USER_STACK_TOP  0xc0000000
+#define USER_STACK_SIZE (64 * 1024)
+#define EXEC_ARGS       16
+
+#define USER_CS         0x1b
+#define USER_DS         0x23
+
+#define VMA_WRITE       1
+
+struct inode_t;
+struct task_t;
+
+/*
+ * a region of a user address space filled in on first touch. Pages below
+ * file_end come from inode at offset (the file position of start), the
+ * rest is zeroed.
+ */
+struct vma_t {
+    uint32_t start;
+    uint32_t end;
+    struct inode_t* inode;
+    uint32_t offset;
+    uint32_t file_end;
+    int flags;
+    struct vma_t* next;
+};
+
+int vma_fault(uint32_t address);
+int user_writable(uint32_t address, size_t size);
+void copy_vmas(struct task_t* task, struct task_t* from);
+void free_vmas(struct task_t* task);
+
+#endif //EXEC_H
@@ -0,0 +1,612 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fat.h"
+#include "buffer.h"
+#include "vfs.h"
+#include "heap.h"
+#include "paging.h"
+#include "task.h"
+#include "kernel.h"
+
+#define FAT12_CLUSTERS 4085
+#define FAT16_CLUSTERS 65525
+
+#define FAT_FREE       0
+#define FAT_FIRST      2
+
+#define ENTRY_SIZE     32
+#define ENTRY_END      0x00
+#define ENTRY_DELETED  0xe5
+
+// boot sector fields, see the bios parameter block in boot/boot.S
+#define BPB_SECTOR_SIZE     11
+#define BPB_CLUSTER_SECTORS 13
+#define BPB_RESERVED        14
+#define BPB_FATS            16
+#define BPB_ROOT_ENTRIES    17
+#define BPB_TOTAL16         19
+#define BPB_FAT_SECTORS     22
+#define BPB_TOTAL32         32
+
+// directory entry fields
+#define DIR_ATTRIBUTES 11
+#define DIR_CLUSTER    26
+#define DIR_SIZE       28
+
+static inline uint16_t get16(const uint8_t* data) {
+    return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t* data) {
+    return get16(data) | ((uint32_t)get16(data + 2) << 16);
+}
+
+static inline void put16(uint8_t* data, uint16_t value) {
+    data[0] = value & 0xff;
+    data[1] = value >> 8;
+}
+
+static inline void put32(uint8_t* data, uint32_t value) {
+    put16(data, value & 0xffff);
+    put16(data + 2, value >> 16);
+}
+
+static inline int is_end(struct fat_t* fs, uint32_t cluster) {
+    return cluster >= (fs->type == 12 ? 0xff8 : 0xfff8);
+}
+
+static inline uint32_t end_of_chain(struct fat_t* fs) {
+    return fs->type == 12 ? 0xfff : 0xffff;
+}
+
+static inline uint32_t cluster_sector(struct fat_t* fs, uint32_t cluster) {
+    return fs->data_start + (cluster - FAT_FIRST) * fs->cluster_sectors;
+}
+
+static uint32_t fat_get(struct fat_t* fs, uint32_t cluster) {
+    if(fs->type == 16)
+        return get16(fs->fat + cluster * 2);
+
+    uint16_t value = get16(fs->fat + cluster + cluster / 2);
+    return (cluster & 1) ? value >> 4 : value & 0xfff;
+}
+
+// copy a changed sector of the cached fat to every fat on disk
+static void fat_store(struct fat_t* fs, uint32_t offset) {
+    uint32_t sector = offset / SECTOR_SIZE;
+
+    for(uint32_t copy = 0; copy < fs->fats; copy++) {
+        struct buffer_t* buffer = getblk(fs->device, fs->fat_start + copy * fs->fat_sectors + sector);
+
+        if(!buffer)
+            continue;
+
+        memcpy(buffer->data, fs->fat + sector * SECTOR_SIZE, SECTOR_SIZE);
+        bdirty(buffer);
+        brelse(buffer);
+    }
+}
+
+static void fat_set(struct fat_t* fs, uint32_t cluster, uint32_t value) {
+    uint32_t offset;
+
+    if(fs->type == 16) {
+        offset = cluster * 2;
+        put16(fs->fat + offset, value);
+    } else {
+        offset = cluster + cluster / 2;
+        uint16_t old = get16(fs->fat + offset);
+
+        if(cluster & 1)
+            put16(fs->fat + offset, (old & 0x000f) | (value << 4));
+        else
+            put16(fs->fat + offset, (old & 0xf000) | (value & 0xfff));
+    }
+
+    // a fat12 entry may straddle two sectors
+    fat_store(fs, offset);
+    if((offset + 1) / SECTOR_SIZE != offset / SECTOR_SIZE)
+        fat_store(fs, offset + 1);
+}
+
+static uint32_t alloc_cluster(struct fat_t* fs) {
+    for(uint32_t i = 0; i < fs->clusters; i++) {
+        uint32_t cluster = FAT_FIRST + (fs->free_hint + i) % fs->clusters;
+
+        if(fat_get(fs, cluster) == FAT_FREE) {
+            fat_set(fs, cluster, end_of_chain(fs));
+            fs->free_hint = cluster - FAT_FIRST + 1;
+            return cluster;
+        }
+    }
+
+    return 0;
+}
+
+static void free_chain(struct fat_t* fs, uint32_t cluster) {
+    while(cluster >= FAT_FIRST && !is_end(fs, cluster)) {
+        uint32_t next = fat_get(fs, cluster);
+        fat_set(fs, cluster, FAT_FREE);
+        cluster = next;
+    }
+}
+
+/*
+ * the cluster holding byte offset of the node, extending the chain when
+ * extend is set. Returns 0 past the end of the chain.
+ */
+static uint32_t seek_cluster(struct fat_t* fs, struct fat_node_t* node, uint32_t offset, int extend) {
+    uint32_t index = offset / (fs->cluster_sectors * SECTOR_SIZE);
+
+    if(!node->first_cluster) {
+        if(!extend || !(node->first_cluster = alloc_cluster(fs)))
+            return 0;
+
+        node->cluster = 0;
+    }
+
+    if(!node->cluster || index < node->cluster_index) {
+        node->cluster = node->first_cluster;
+        node->cluster_index = 0;
+    }
+
+    while(node->cluster_index < index) {
+        uint32_t next = fat_get(fs, node->cluster);
+
+        if(is_end(fs, next)) {
+            if(!extend || !(next = alloc_cluster(fs)))
+                return 0;
+
+            fat_set(fs, node->cluster, next);
+        }
+
+        node->cluster = next;
+        node->cluster_index++;
+    }
+
+    return node->cluster;
+}
+
+/*
+ * move data between the file and a kernel bounce buffer a run of
+ * consecutive clusters at a time, each run is one disk request. A write
+ * reads the partial sectors at the edges of the run first.
+ */
+static int fat_transfer(struct fat_t* fs, struct fat_node_t* node, uint32_t offset,
+                        uint8_t* data, size_t size, int write) {
+    uint32_t cluster_size = fs->cluster_sectors * SECTOR_SIZE;
+    uint8_t* bounce = (uint8_t*)kmalloc(FAT_RUN_SECTORS * SECTOR_SIZE);
+    size_t done = 0;
+
+    if(!bounce)
+        return -1;
+
+    while(done < size) {
+        uint32_t cluster = seek_cluster(fs, node, offset, write);
+
+        if(!cluster)
+            break;
+
+        uint32_t first = cluster_sector(fs, cluster) + (offset % cluster_size) / SECTOR_SIZE;
+        uint32_t skip = offset % SECTOR_SIZE;
+        uint32_t sectors = fs->cluster_sectors - (offset % cluster_size) / SECTOR_SIZE;
+
+        if(sectors > FAT_RUN_SECTORS)
+            sectors = FAT_RUN_SECTORS;
+
+        // grow the run while the chain stays contiguous on disk
+        while(sectors < FAT_RUN_SECTORS && skip + size - done > sectors * SECTOR_SIZE) {
+            uint32_t next = fat_get(fs, node->cluster);
+
+            if(next != node->cluster + 1 || sectors + fs->cluster_sectors > FAT_RUN_SECTORS)
+                break;
+
+            node->cluster = next;
+            node->cluster_index++;
+            sectors += fs->cluster_sectors;
+        }
+
+        uint32_t count = sectors * SECTOR_SIZE - skip;
+        if(count > size - done)
+            count = size - done;
+
+        sectors = (skip + count + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+        if(write) {
+            uint32_t last = sectors - 1;
+
+            if(skip && block_read(fs->device, first, 1, bounce) < 0)
+                break;
+
+            if((skip + count) % SECTOR_SIZE && (last || !skip) &&
+               block_read(fs->device, first + last, 1, bounce + last * SECTOR_SIZE) < 0)
+                break;
+
+            memcpy(bounce + skip, data + done, count);
+
+            if(block_write(fs->device, first, sectors, bounce) < 0)
+                break;
+        } else {
+            if(block_read(fs->device, first, sectors, bounce) < 0)
+                break;
+
+            memcpy(data + done, bounce + skip, count);
+        }
+
+        done += count;
+        offset += count;
+    }
+
+    kfree(bounce);
+    return done;
+}
+
+static void update_entry(struct fat_t* fs, struct fat_node_t* node) {
+    if(!node->entry_sector)
+        return;
+
+    struct buffer_t* buffer = bread(fs->device, node->entry_sector);
+
+    if(!buffer)
+        return;
+
+    uint8_t* entry = buffer->data + node->entry_offset;
+    put16(entry + DIR_CLUSTER, node->first_cluster);
+    put32(entry + DIR_SIZE, (node->attributes & FAT_DIRECTORY) ? 0 : node->size);
+
+    bdirty(buffer);
+    brelse(buffer);
+}
+
+static int fat_read(struct fat_t* fs, struct fat_node_t* node, uint32_t offset, void* buffer, size_t size) {
+    if(offset >= node->size)
+        return 0;
+
+    if(size > node->size - offset)
+        size = node->size - offset;
+
+    return fat_transfer(fs, node, offset, (uint8_t*)buffer, size, 0);
+}
+
+static int fat_write(struct fat_t* fs, struct fat_node_t* node, uint32_t offset, const void* buffer, size_t size) {
+    int written = fat_transfer(fs, node, offset, (uint8_t*)buffer, size, 1);
+
+    if(written > 0 && offset + written > node->size)
+        node->size = offset + written;
+
+    update_entry(fs, node);
+    return written;
+}
+
+static int fat_truncate(struct fat_t* fs, struct fat_node_t* node) {
+    free_chain(fs, node->first_cluster);
+
+    node->first_cluster = 0;
+    node->cluster = 0;
+    node->size = 0;
+
+    update_entry(fs, node);
+    return 0;
+}
+
+// the index-th sector of a directory, 0 past its end
+static uint32_t dir_sector(struct fat_t* fs, struct fat_node_t* dir, uint32_t index) {
+    if(!dir->first_cluster)
+        return index < fs->root_sectors ? fs->root_start + index : 0;
+
+    uint32_t cluster = seek_cluster(fs, dir, index * SECTOR_SIZE, 0);
+    if(!cluster)
+        return 0;
+
+    return cluster_sector(fs, cluster) + index % fs->cluster_sectors;
+}
+
+// "name.ext" to the padded upper case form of a directory entry
+static int to_short_name(const char* name, size_t length, char* short_name) {
+    size_t i = 0, out = 0;
+
+    memset(short_name, ' ', FAT_NAME);
+
+    for(; i < length && name[i] != '.'; i++, out++) {
+        if(out == 8)
+            return -1;
+        short_name[out] = name[i];
+    }
+
+    // ".", ".." and ".ab" have no base name
+    if(!out)
+        return -1;
+
+    if(i < length) {
+        for(i++, out = 8; i < length; i++, out++) {
+            if(out == FAT_NAME)
+                return -1;
+            short_name[out] = name[i];
+        }
+    }
+
+    for(i = 0; i < FAT_NAME; i++) {
+        if(short_name[i] >= 'a' && short_name[i] <= 'z')
+            short_name[i] -= 'a' - 'A';
+    }
+
+    return 0;
+}
+
+/*
+ * look name up in dir. With a null name, find a free entry instead. The
+ * entry's location is always filled in.
+ */
+static int dir_find(struct fat_t* fs, struct fat_node_t* dir, const char* name, struct fat_node_t* node) {
+    for(uint32_t index = 0;; index++) {
+        uint32_t sector = dir_sector(fs, dir, index);
+        if(!sector)
+            return -1;
+
+        struct buffer_t* buffer = bread(fs->device, sector);
+        if(!buffer)
+            return -1;
+
+        for(uint32_t offset = 0; offset < SECTOR_SIZE; offset += ENTRY_SIZE) {
+            uint8_t* entry = buffer->data + offset;
+            int free = entry[0] == ENTRY_END || entry[0] == ENTRY_DELETED;
+
+            if(!name && free) {
+                node->entry_sector = sector;
+                node->entry_offset = offset;
+                brelse(buffer);
+                return 0;
+            }
+
+            if(entry[0] == ENTRY_END) {
+                brelse(buffer);
+                return -1;
+            }
+
+            if(free || entry[DIR_ATTRIBUTES] == FAT_LONG_NAME || (entry[DIR_ATTRIBUTES] & FAT_VOLUME))
+                continue;
+
+            if(name && memcmp(entry, name, FAT_NAME) == 0) {
+                node->first_cluster = get16(entry + DIR_CLUSTER);
+                node->size = get32(entry + DIR_SIZE);
+                node->attributes = entry[DIR_ATTRIBUTES];
+                node->entry_sector = sector;
+                node->entry_offset = offset;
+                node->cluster = 0;
+                node->cluster_index = 0;
+                brelse(buffer);
+                return 0;
+            }
+        }
+
+        brelse(buffer);
+    }
+}
+
+static void root_node(struct fat_node_t* node) {
+    memset(node, 0, sizeof(struct fat_node_t));
+    node->attributes = FAT_DIRECTORY;
+}
+
+struct fat_t* fat_mount(struct block_device_t* device) {
+    struct fat_t fat;
+    struct buffer_t* boot = bread(device, 0);
+
+    memset(&fat, 0, sizeof(struct fat_t));
+
+    if(!boot)
+        return 0;
+
+    const uint8_t* bpb = boot->data;
+    uint32_t sector_size = get16(bpb + BPB_SECTOR_SIZE);
+    uint32_t root_entries = get16(bpb + BPB_ROOT_ENTRIES);
+    uint32_t total = get16(bpb + BPB_TOTAL16) ? get16(bpb + BPB_TOTAL16) : get32(bpb + BPB_TOTAL32);
+
+    fat.device = device;
+    fat.cluster_sectors = bpb[BPB_CLUSTER_SECTORS];
+    fat.fat_start = get16(bpb + BPB_RESERVED);
+    fat.fat_sectors = get16(bpb + BPB_FAT_SECTORS);
+    fat.fats = bpb[BPB_FATS];
+
+    brelse(boot);
+
+    // fat32 has no fixed root directory
+    if(sector_size != SECTOR_SIZE || !fat.cluster_sectors || !root_entries || !fat.fat_sectors)
+        return 0;
+
+    fat.root_start = fat.fat_start + fat.fats * fat.fat_sectors;
+    fat.root_sectors = (root_entries * ENTRY_SIZE + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    fat.data_start = fat.root_start + fat.root_sectors;
+
+    if(total <= fat.data_start)
+        return 0;
+
+    fat.clusters = (total - fat.data_start) / fat.cluster_sectors;
+    fat.type = fat.clusters < FAT12_CLUSTERS ? 12 : 16;
+    fat.free_hint = 0;
+
+    if(fat.clusters >= FAT16_CLUSTERS)
+        return 0;
+
+    struct fat_t* fs = (struct fat_t*)kmalloc(sizeof(struct fat_t));
+    fat.fat = (uint8_t*)kmalloc(fat.fat_sectors * SECTOR_SIZE);
+
+    // a big fat takes several requests, block_read splits it
+    if(!fs || !fat.fat || block_read(device, fat.fat_start, fat.fat_sectors, fat.fat) < 0) {
+        kfree(fat.fat);
+        kfree(fs);
+        return 0;
+    }
+
+    *fs = fat;
+    return fs;
+}
+
+struct fat_inode_t {
+    struct fat_t* fs;
+    struct fat_node_t node;
+    struct inode_t* inode;
+    struct fat_inode_t* next;
+};
+
+static const struct inode_ops_t fat_inode_ops;
+
+// names are case insensitive, "a.txt" and "A.TXT" must share an inode
+static struct fat_inode_t* fat_inodes;
+
+static struct inode_t* fat_inode(struct fat_t* fs, struct fat_node_t* node) {
+    struct fat_inode_t* data;
+
+    for(data = fat_inodes; data; data = data->next) {
+        if(data->fs == fs && data->node.entry_sector == node->entry_sector &&
+           data->node.entry_offset == node->entry_offset)
+            return data->inode;
+    }
+
+    if(!(data = (struct fat_inode_t*)kmalloc(sizeof(struct fat_inode_t))))
+        return 0;
+
+    int type = (node->attributes & FAT_DIRECTORY) ? VFS_DIRECTORY : VFS_FILE;
+
+    if(!(data->inode = alloc_inode(&fat_inode_ops, data, type, node->size))) {
+        kfree(data);
+        return 0;
+    }
+
+    data->fs = fs;
+    data->node = *node;
+    data->next = fat_inodes;
+    fat_inodes = data;
+
+    return data->inode;
+}
+
+static int fat_inode_lookup(struct inode_t* dir, const char* name, size_t length, struct inode_t** inode) {
+    struct fat_inode_t* data = (struct fat_inode_t*)dir->data;
+    char short_name[FAT_NAME];
+    struct fat_node_t node;
+    int result = -1;
+
+    lock(&data->fs->lock);
+
+    if(to_short_name(name, length, short_name) == 0 && dir_find(data->fs, &data->node, short_name, &node) == 0)
+        result = (*inode = fat_inode(data->fs, &node)) ? 0 : -1;
+
+    unlock(&data->fs->lock);
+    return result;
+}
+
+// an empty file in a free entry of the directory, directories don't grow
+static int fat_inode_create(struct inode_t* dir, const char* name, size_t length, struct inode_t** inode) {
+    struct fat_inode_t* data = (struct fat_inode_t*)dir->data;
+    struct fat_t* fs = data->fs;
+    char short_name[FAT_NAME];
+    struct fat_node_t node;
+    struct buffer_t* buffer;
+    int result;
+
+    if(to_short_name(name, length, short_name) < 0)
+        return -1;
+
+    lock(&fs->lock);
+
+    // another task may have created it since the lookup failed
+    if(dir_find(fs, &data->node, short_name, &node) == 0) {
+        result = (*inode = fat_inode(fs, &node)) ? 0 : -1;
+        unlock(&fs->lock);
+        return result;
+    }
+
+    if(dir_find(fs, &data->node, 0, &node) < 0 || !(buffer = bread(fs->device, node.entry_sector))) {
+        unlock(&fs->lock);
+        return -1;
+    }
+
+    uint8_t* entry = buffer->data + node.entry_offset;
+    memset(entry, 0, ENTRY_SIZE);
+    memcpy(entry, short_name, FAT_NAME);
+    entry[DIR_ATTRIBUTES] = FAT_ARCHIVE;
+
+    bdirty(buffer);
+    brelse(buffer);
+
+    node.first_cluster = 0;
+    node.size = 0;
+    node.attributes = FAT_ARCHIVE;
+    node.cluster = 0;
+    node.cluster_index = 0;
+
+    result = (*inode = fat_inode(fs, &node)) ? 0 : -1;
+    unlock(&fs->lock);
+    return result;
+}
+
+static int fat_inode_readpage(struct inode_t* inode, uint32_t index, void* page) {
+    struct fat_inode_t* data = (struct fat_inode_t*)inode->data;
+
+    lock(&data->fs->lock);
+    int count = fat_read(data->fs, &data->node, index * PAGE_SIZE, page, PAGE_SIZE);
+    unlock(&data->fs->lock);
+
+    if(count < 0)
+        return -1;
+
+    memset((uint8_t*)page + count, 0, PAGE_SIZE - count);
+    return 0;
+}
+
+static int fat_inode_write(struct inode_t* inode, uint32_t offset, const void* buffer, size_t size) {
+    struct fat_inode_t* data = (struct fat_inode_t*)inode->data;
+
+    lock(&data->fs->lock);
+    int count = fat_write(data->fs, &data->node, offset, buffer, size);
+    inode->size = data->node.size;
+    unlock(&data->fs->lock);
+
+    return count;
+}
+
+static int fat_inode_truncate(struct inode_t* inode) {
+    struct fat_inode_t* data = (struct fat_inode_t*)inode->data;
+
+    lock(&data->fs->lock);
+    fat_truncate(data->fs, &data->node);
+    inode->size = 0;
+    unlock(&data->fs->lock);
+
+    return 0;
+}
+
+static const struct inode_ops_t fat_inode_ops = {
+    .lookup = fat_inode_lookup,
+    .create = fat_inode_create,
+    .readpage = fat_inode_readpage,
+    .write = fat_inode_write,
+    .truncate = fat_inode_truncate,
+};
+
+struct inode_t* fat_root(struct fat_t* fs) {
+    struct fat_node_t node;
+
+    root_node(&node);
+    return fat_inode(fs, &node);
+}
+
+void init_fat() {
+    struct block_device_t* device = find_block_device("hda");
+    struct fat_t* fs;
+    struct inode_t* root;
+
+    if(!device)
+        return;
+
+    if(!(fs = fat_mount(device)) || !(root = fat_root(fs))) {
+        kprintf("hda: no fat filesystem\n");
+        return;
+    }
+
+    // under the initrd when there is one
+    vfs_mount(vfs_lookup("/") ? "/hda" : "/", root);
+    kprintf("hda: fat%d, %d clusters of %d sectors\n", fs->type, fs->clusters, fs->cluster_sectors);
+}
@@ -0,0 +1,53 @@
+#ifndef FAT_H
+#define FAT_H
+
+#include "block.h"
+#include "vfs.h"
+
+#define FAT_NAME 11
+
+#define FAT_READ_ONLY 0x01
+#define FAT_VOLUME    0x08
+#define FAT_DIRECTORY 0x10
+#define FAT_ARCHIVE   0x20
+#define FAT_LONG_NAME 0x0f
+
+// largest run of clusters read or written with one request
+#define FAT_RUN_SECTORS 64
+
+struct fat_t {
+    struct block_device_t* device;
+    int type; // 12 or 16
+    uint32_t cluster_sectors;
+    uint32_t fat_start;
+    uint32_t fat_sectors;
+    uint32_t fats;
+    uint32_t root_start;
+    uint32_t root_sectors;
+    uint32_t data_start;
+    uint32_t clusters;
+    uint8_t* fat; // every fat sector, cached at mount
+    uint32_t free_hint;
+    struct lock_t lock; // held by the inode ops, the fat and the chain cursors are shared
+};
+
+/*
+ * a file or directory, found through its directory entry. The root
+ * directory has no entry (entry_sector 0) and no clusters, it is the fixed
+ * area after the fats. cluster/cluster_index remember the last position
+ * in the chain so sequential access doesn't walk it from the start.
+ */
+struct fat_node_t {
+    uint32_t first_cluster;
+    uint32_t size;
+    uint8_t attributes;
+    uint32_t entry_sector;
+    uint32_t entry_offset;
+    uint32_t cluster;
+    uint32_t cluster_index;
+};
+
+struct fat_t* fat_mount(struct block_device_t* device);
+struct inode_t* fat_root(struct fat_t* fs);
+
+#endif //FAT_H
@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "file.h"
+#include "task.h"
+#include "heap.h"
+#include "vfs.h"
+#include "exec.h"
+#include "global.h"
+
+struct file_t* alloc_file(const struct file_ops_t* ops, void* data, int flags) {
+    struct file_t* file = (struct file_t*)kmalloc(sizeof(struct file_t));
+
+    if(file) {
+        file->ops = ops;
+        file->data = data;
+        file->flags = flags;
+        file->refs = 1;
+        file->offset = 0;
+    }
+
+    return file;
+}
+
+void file_get(struct file_t* file) {
+    file->refs++;
+}
+
+void file_put(struct file_t* file) {
+    if(--file->refs > 0)
+        return;
+
+    if(file->ops->close)
+        file->ops->close(file);
+
+    kfree(file);
+}
+
+// lowest free descriptor of the current task, or -1
+int install_file(struct file_t* file) {
+    for(int fd = 0; fd < TASK_FILES; fd++) {
+        if(!current_task->files[fd]) {
+            current_task->files[fd] = file;
+            return fd;
+        }
+    }
+
+    return -1;
+}
+
+// FILE_READ/FILE_WRITE for the access mode in open flags
+int open_mode(int flags) {
+    switch(flags & O_ACCMODE) {
+    case O_RDONLY: return FILE_READ;
+    case O_WRONLY: return FILE_WRITE;
+    default:       return FILE_READ | FILE_WRITE;
+    }
+}
+
+static struct file_t* get_file(int fd) {
+    if(fd < 0 || fd >= TASK_FILES)
+        return 0;
+
+    return current_task->files[fd];
+}
+
+void dup_files(struct task_t* child, struct task_t* parent) {
+    for(int fd = 0; fd < TASK_FILES; fd++) {
+        if(parent->files[fd]) {
+            child->files[fd] = parent->files[fd];
+            file_get(child->files[fd]);
+        }
+    }
+}
+
+void close_files(struct task_t* task) {
+    for(int fd = 0; fd < TASK_FILES; fd++) {
+        if(task->files[fd]) {
+            file_put(task->files[fd]);
+            task->files[fd] = 0;
+        }
+    }
+}
+
+// open(path, flags)
+void system_open() {
+    struct trap_t* trap = current_task->trap;
+    struct file_t* file = vfs_open((const char*)trap->ebx, trap->esi);
+    int fd;
+
+    if(!file) {
+        trap->eax = -1;
+        return;
+    }
+
+    if((fd = install_file(file)) < 0)
+        file_put(file);
+
+    trap->eax = fd;
+}
+
+// read(fd, buffer, size)
+void system_read() {
+    struct trap_t* trap = current_task->trap;
+    struct file_t* file = get_file(trap->ebx);
+
+    if(!file || !(file->flags & FILE_READ) || !file->ops->read || !user_writable(trap->esi, trap->edi)) {
+        trap->eax = -1;
+        return;
+    }
+
+    trap->eax = file->ops->read(file, (void*)trap->esi, trap->edi);
+}
+
+// write(fd, buffer, size)
+void system_write() {
+    struct trap_t* trap = current_task->trap;
+    struct file_t* file = get_file(trap->ebx);
+
+    if(!file || !(file->flags & FILE_WRITE) || !file->ops->write) {
+        trap->eax = -1;
+        return;
+    }
+
+    trap->eax = file->ops->write(file, (const void*)trap->esi, trap->edi);
+}
+
+// close(fd)
+void system_close() {
+    struct trap_t* trap = current_task->trap;
+    struct file_t* file = get_file(trap->ebx);
+
+    if(!file) {
+        trap->eax = -1;
+        return;
+    }
+
+    current_task->files[trap->ebx] = 0;
+    file_put(file);
+    trap->eax = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef FILE_H
+#define FILE_H
+
+#define FILE_READ  (1 << 0)
+#define FILE_WRITE (1 << 1)
+
+// open flags
+#define O_RDONLY  0
+#define O_WRONLY  1
+#define O_RDWR    2
+#define O_ACCMODE 3
+#define O_CREAT   0x40
+#define O_TRUNC   0x200
+
+struct file_t;
+struct task_t;
+
+struct file_ops_t {
+    int (*read)(struct file_t* file, void* buffer, size_t size);
+    int (*write)(struct file_t* file, const void* buffer, size_t size);
+    void (*close)(struct file_t* file);
+};
+
+struct file_t {
+    const struct file_ops_t* ops;
+    void* data;
+    int flags;
+    int refs;
+    uint32_t offset;
+};
+
+struct file_t* alloc_file(const struct file_ops_t* ops, void* data, int flags);
+void file_get(struct file_t* file);
+void file_put(struct file_t* file);
+
+int install_file(struct file_t* file);
+int open_mode(int flags);
+
+void dup_files(struct task_t* child, struct task_t* parent);
+void close_files(struct task_t* task);
+
+#endif //FILE_H
@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fpu.h"
+#include "task.h"
+#include "interrupt.h"
+#include "heap.h"
+#include "asm.h"
+#include "global.h"
+#include "kernel.h"
+
+#define CR0_MP        (1 << 1)
+#define CR0_EM        (1 << 2)
+#define CR0_TS        (1 << 3)
+#define CR0_NE        (1 << 5)
+
+#define CR4_OSFXSR    (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+#define CPUID_FPU     (1 << 0)
+#define CPUID_FXSR    (1 << 24)
+#define CPUID_SSE     (1 << 25)
+
+#define FXSAVE_SIZE   512
+#define FNSAVE_SIZE   108
+
+/*
+ * lazy fpu switching
+ *
+ * the registers stay loaded with the state of fpu_owner. Switching to any
+ * other task sets CR0.TS, so its first fpu/sse instruction raises #NM and
+ * only then the owner state is saved and the new one restored. Tasks that
+ * never touch the fpu never get a save area.
+ */
+
+static struct task_t* fpu_owner = 0;
+static int has_fxsr = 0;
+static int ts_set = 0;
+static size_t fpu_state_size = FNSAVE_SIZE;
+static uint8_t fpu_initial_state[FXSAVE_SIZE] __attribute__((aligned(16)));
+
+static inline uint32_t read_cr0() {
+    uint32_t cr0;
+    __asm__ __volatile__ ("movl %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+    __asm__ __volatile__ ("movl %0, %%cr0" : : "r"(cr0));
+}
+
+static inline void clts() {
+    __asm__ __volatile__ ("clts");
+    ts_set = 0;
+}
+
+static inline void stts() {
+    write_cr0(read_cr0() | CR0_TS);
+    ts_set = 1;
+}
+
+static void fpu_save(void* state) {
+    if(has_fxsr)
+        __asm__ __volatile__ ("fxsave (%0)" : : "r"(state) : "memory");
+    else
+        __asm__ __volatile__ ("fnsave (%0); fwait" : : "r"(state) : "memory");
+}
+
+static void fpu_restore(const void* state) {
+    if(has_fxsr)
+        __asm__ __volatile__ ("fxrstor (%0)" : : "r"(state));
+    else
+        __asm__ __volatile__ ("frstor (%0)" : : "r"(state));
+}
+
+static void* fpu_alloc_state() {
+    void* state = kamalloc(fpu_state_size, 16);
+    memcpy(state, fpu_initial_state, fpu_state_size);
+    return state;
+}
+
+// #NM, a task without the fpu registers executed an fpu/sse instruction
+void fpu_handler() {
+    struct task_t* task = current_task;
+
+    clts();
+
+    if(fpu_owner == task)
+        return;
+
+    if(fpu_owner)
+        fpu_save(fpu_owner->fpu_state);
+
+    if(!task->fpu_state)
+        task->fpu_state = fpu_alloc_state();
+
+    fpu_restore(task->fpu_state);
+    fpu_owner = task;
+}
+
+// called by schedule() before switching to next
+void fpu_switch(struct task_t* next) {
+    if(next == fpu_owner) {
+        if(ts_set) clts();
+    } else {
+        if(!ts_set) stts();
+    }
+}
+
+void fpu_fork(struct task_t* child, struct task_t* parent) {
+    if(!parent->fpu_state)
+        return;
+
+    if(fpu_owner == parent) {
+        // fnsave reinitializes the fpu, reload to keep the registers live
+        fpu_save(parent->fpu_state);
+        if(!has_fxsr)
+            fpu_restore(parent->fpu_state);
+    }
+
+    child->fpu_state = kamalloc(fpu_state_size, 16);
+    memcpy(child->fpu_state, parent->fpu_state, fpu_state_size);
+}
+
+// the registers are left alone, an exec'ing task must still trap on its next use
+void fpu_release(struct task_t* task) {
+    if(fpu_owner == task) {
+        fpu_owner = 0;
+        stts();
+    }
+
+    kfree(task->fpu_state);
+    task->fpu_state = 0;
+}
+
+void init_fpu() {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    if(!(edx & CPUID_FPU)) {
+        kprintf("no fpu found\n");
+        return;
+    }
+
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+
+    if(edx & CPUID_FXSR) {
+        uint32_t cr4;
+        __asm__ __volatile__ ("movl %%cr4, %0" : "=r"(cr4));
+
+        cr4 |= CR4_OSFXSR;
+        if(edx & CPUID_SSE)
+            cr4 |= CR4_OSXMMEXCPT;
+
+        __asm__ __volatile__ ("movl %0, %%cr4" : : "r"(cr4));
+
+        has_fxsr = 1;
+        fpu_state_size = FXSAVE_SIZE;
+    }
+
+    __asm__ __volatile__ ("fninit");
+
+    if(edx & CPUID_SSE) {
+        uint32_t mxcsr = 0x1f80;
+        __asm__ __volatile__ ("ldmxcsr %0" : : "m"(mxcsr));
+    }
+
+    fpu_save(fpu_initial_state);
+
+    register_interrupt_handler(7, &fpu_handler);
+
+    // nobody owns the fpu yet, the first user traps
+    stts();
+}
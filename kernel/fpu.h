@@ -0,0 +1,10 @@
+#ifndef FPU_H
+#define FPU_H
+
+struct task_t;
+
+void fpu_switch(struct task_t* next);
+void fpu_fork(struct task_t* child, struct task_t* parent);
+void fpu_release(struct task_t* task);
+
+#endif //FPU_H
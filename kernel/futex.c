@@ -0,0 +1,129 @@
+#include <stdint.h>
+
+#include "futex.h"
+#include "task.h"
+#include "paging.h"
+#include "exec.h"
+#include "global.h"
+
+#define FUTEX_BUCKETS 64
+
+/*
+ * waiters hash by the physical address of the futex word, tasks sharing it
+ * through different mappings meet in the same bucket. A bucket is a plain
+ * wait queue, task_t.futex_key tells which word each sleeper waits on.
+ */
+
+static struct wait_queue_t futex_queues[FUTEX_BUCKETS];
+
+static struct wait_queue_t* futex_bucket(uint32_t key) {
+    return &futex_queues[(key >> 2) % FUTEX_BUCKETS];
+}
+
+static uint32_t futex_key(uint32_t address) {
+    if(address & 3)
+        return ~0;
+
+    // a demand paged word has no frame until it is touched
+    if(!is_page_present(current_directory, address) && vma_fault(address) < 0)
+        return ~0;
+
+    return get_mapping(current_directory, address);
+}
+
+// unlink the first max sleepers on key and hand them to fn
+static int futex_take(struct wait_queue_t* queue, uint32_t key, int max,
+        void (*fn)(struct task_t*, void*), void* data) {
+    struct task_t** link = &queue->head;
+    struct task_t* previous = 0;
+    int count = 0;
+
+    while(*link && count < max) {
+        struct task_t* task = *link;
+
+        if(task->futex_key != key) {
+            previous = task;
+            link = &task->wait_next;
+            continue;
+        }
+
+        *link = task->wait_next;
+        if(queue->tail == task)
+            queue->tail = previous;
+
+        task->wait_next = 0;
+        fn(task, data);
+        count++;
+    }
+
+    return count;
+}
+
+static void futex_wake_task(struct task_t* task, void* data) {
+    wake_task(task);
+}
+
+static void futex_move_task(struct task_t* task, void* data) {
+    struct wait_queue_t* queue = futex_bucket(*(uint32_t*)data);
+
+    task->futex_key = *(uint32_t*)data;
+
+    if(queue->tail)
+        queue->tail->wait_next = task;
+    else
+        queue->head = task;
+
+    queue->tail = task;
+}
+
+// futex(addr, op, val), runs with interrupts disabled so the value check
+// and going to sleep can't race with a wake
+void system_futex() {
+    struct trap_t* trap = current_task->trap;
+    uint32_t address = trap->ebx;
+    int op = trap->esi;
+    uint32_t val = trap->edi;
+
+    uint32_t key = futex_key(address);
+    if(key == ~0u) {
+        trap->eax = -1;
+        return;
+    }
+
+    struct wait_queue_t* queue = futex_bucket(key);
+
+    switch(op) {
+    case FUTEX_WAIT:
+        if(*(volatile uint32_t*)address != val) {
+            trap->eax = -1;
+            return;
+        }
+
+        current_task->futex_key = key;
+        sleep_on(queue);
+        trap->eax = 0;
+        break;
+
+    case FUTEX_WAKE:
+        // the count is unsigned, ~0u wakes everybody
+        trap->eax = futex_take(queue, key, val > ~0u >> 1 ? ~0u >> 1 : val, futex_wake_task, 0);
+        break;
+
+    case FUTEX_REQUEUE: {
+        uint32_t key2 = futex_key(val);
+        if(key2 == ~0u) {
+            trap->eax = -1;
+            return;
+        }
+
+        trap->eax = futex_take(queue, key, 1, futex_wake_task, 0);
+        if(key2 != key)
+            futex_take(queue, key, ~0u >> 1, futex_move_task, &key2);
+        break;
+    }
+
+    default:
+        trap->eax = -1;
+        break;
+    }
+}
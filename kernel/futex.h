@@ -0,0 +1,47 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "syscall.h"
+
+#define FUTEX_WAIT    0 // sleep if *addr == val
+#define FUTEX_WAKE    1 // wake up to val waiters
+#define FUTEX_REQUEUE 2 // wake one waiter, move the others to addr2 (val)
+
+static inline int futex(volatile int* addr, int op, uint32_t val) {
+    return syscall(SYSTEM_futex, (uint32_t)addr, op, val);
+}
+
+/*
+ * mutex on top of futex
+ *
+ * state 0 is unlocked, 1 locked, 2 locked with (possible) waiters. Only
+ * the 2 state enters the kernel, an uncontended lock/unlock is a single
+ * atomic instruction each.
+ */
+struct mutex_t {
+    volatile int state;
+};
+
+static inline void mutex_lock(struct mutex_t* mutex) {
+    int state = __sync_val_compare_and_swap(&mutex->state, 0, 1);
+
+    if(state == 0)
+        return;
+
+    if(state != 2)
+        state = __sync_lock_test_and_set(&mutex->state, 2);
+
+    while(state != 0) {
+        futex(&mutex->state, FUTEX_WAIT, 2);
+        state = __sync_lock_test_and_set(&mutex->state, 2);
+    }
+}
+
+static inline void mutex_unlock(struct mutex_t* mutex) {
+    if(__sync_fetch_and_sub(&mutex->state, 1) != 1) {
+        mutex->state = 0;
+        futex(&mutex->state, FUTEX_WAKE, 1);
+    }
+}
+
+#endif //FUTEX_H
@@ -12,14 +12,19 @@ extern const char __bss_start[];
 extern const char __bss_end[];
 
 // start.S
+#define BOOT_STACK_SIZE 0x8000 // STACK_SIZE in start.S
 extern const char __stack[];
 
+// descriptor.c
+extern uint32_t kernel_stack_top;
+
 // paging.c
 extern struct pde_t* kernel_directory;
 extern struct pde_t* current_directory;
 
 // task.c
 extern struct task_t* current_task;
+extern struct task_t* task_list;
 
 // trap.S
 extern uint32_t trap_vector[];
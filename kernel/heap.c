@@ -3,6 +3,7 @@
 
 #include "heap.h"
 #include "global.h"
+#include "trace.h"
 #include "kernel.h"
 
 struct header_t {
@@ -118,8 +119,10 @@ void* heap_alloc(struct heap_t* heap, size_t size, size_t align) {
     struct header_t* smallest = heap_find_smallest(heap, required_size, align);
     uint32_t address = (uint32_t)smallest;
 
-    if(smallest == 0)
+    if(smallest == 0) {
+        trace(TRACE_HEAP_ALLOC, size, align, 0, 0);
         return 0;
+    }
 
     heap->free_list = remove_list(heap->free_list, smallest);
 
@@ -157,6 +160,8 @@ void* heap_alloc(struct heap_t* heap, size_t size, size_t align) {
         heap->free_list = insert_list(heap->free_list, right_header);
     }
 
+    trace(TRACE_HEAP_ALLOC, size, align, address + sizeof(struct header_t), 0);
+
     return (void*)(address + sizeof(struct header_t));
 }
 
@@ -230,6 +235,14 @@ void kfree(void* ptr) {
 
 static uint32_t current_memory = (uint32_t) __kernel_end;
 
+// keep the heap above end, for boot modules loaded after the kernel
+void reserve_memory(uint32_t end) {
+    end = (end + 0xfff) & ~0xfff;
+
+    if(end > current_memory)
+        current_memory = end;
+}
+
 void init_kernel_heap(uint32_t max_memory) {
     kernel_heap = (struct heap_t*)current_memory;
     current_memory += sizeof(struct heap_t);
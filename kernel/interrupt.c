@@ -2,10 +2,13 @@
 #include <string.h>
 
 #include "interrupt.h"
+#include "softirq.h"
 #include "paging.h"
 #include "task.h"
 #include "global.h"
 #include "asm.h"
+#include "trace.h"
+#include "kernel.h"
 
 #define MASTER_PIC         0x20
 #define MASTER_PIC_COMMAND MASTER_PIC
@@ -33,6 +36,7 @@
 #define OCW2_EOI           0x20
 
 static interrupt_handler_t interrupt_table[256];
+static int irq_depth;
 
 // initialize Programmable Interrupt Controller (i8259)
 void init_interrupt_controller() {
@@ -61,6 +65,16 @@ void register_interrupt_handler(int intr, interrupt_handler_t callback) {
     interrupt_table[intr] = callback;
 }
 
+// unmask an irq line, the bios may leave it masked
+void enable_irq(int intrno) {
+    int line = intrno - IRQ0;
+
+    if(line >= 8)
+        outb(SLAVE_PIC_DATA, inb(SLAVE_PIC_DATA) & ~(1 << (line - 8)));
+    else
+        outb(MASTER_PIC_DATA, inb(MASTER_PIC_DATA) & ~(1 << line));
+}
+
 static void end_of_interrupt(int intrno) {
     if(intrno >= 0x28)
         outb(SLAVE_PIC_COMMAND, OCW2_EOI);
@@ -68,15 +82,50 @@ static void end_of_interrupt(int intrno) {
     outb(MASTER_PIC_COMMAND, OCW2_EOI);
 }
 
+// exceptions and system calls, see trap_common
 void handle_interrupt(struct trap_t* trap) {
+    // a page fault inside a system call must leave the call its frame
+    struct trap_t* outer = current_task->trap;
+
     current_task->trap = trap;
 
+    trace(TRACE_INTERRUPT, trap->interrupt_number, trap->error_code, trap->eip, 0);
+
+    interrupt_handler_t handler = interrupt_table[trap->interrupt_number];
+    if(handler != 0) {
+        handler(trap);
+    } else if(trap->interrupt_number < IRQ0 && (trap->cs & 0x3)) {
+        // returning would fault again, the task can't go on
+        kprintf("pid %d: exception %d at eip 0x%x\n", current_task->pid, trap->interrupt_number, trap->eip);
+        do_exit(-1);
+    }
+
+    current_task->trap = outer;
+}
+
+// hardware interrupts, see irq_common
+void handle_irq(struct trap_t* trap) {
     int intrno = trap->interrupt_number;
-    
+
+    trace(TRACE_IRQ, intrno, trap->eip, 0, 0);
+
     end_of_interrupt(intrno);
 
-    interrupt_handler_t handler = interrupt_table[intrno];
-    if(handler != 0)
-        handler(trap);
+    // the timer can switch tasks, it is not counted as irq context
+    if(intrno == IRQ0) {
+        timer_callback(trap);
+    } else {
+        interrupt_handler_t handler = interrupt_table[intrno];
+
+        irq_depth++;
+        if(handler != 0)
+            handler(trap);
+        irq_depth--;
+    }
+
+    do_softirq();
 }
 
+int in_irq() {
+    return irq_depth > 0;
+}
@@ -4,6 +4,8 @@
 typedef void (*interrupt_handler_t)();
 
 void register_interrupt_handler(int interrupt, interrupt_handler_t callback);
+void enable_irq(int interrupt);
+int in_irq();
 
 #define IRQ0 32
 
@@ -0,0 +1,168 @@
+#include <stdint.h>
+
+#include "ipc.h"
+#include "task.h"
+#include "global.h"
+
+/*
+ * fast path ipc
+ *
+ * when the partner is already blocked waiting for us the message is copied
+ * register to register into its trap frame and we switch straight to it
+ * with handoff(), the ready queue never sees it. Otherwise the sender
+ * parks on the receiver ipc_senders queue with the message in its task.
+ */
+
+static int accepts(struct task_t* receiver, struct task_t* sender) {
+    return receiver->ipc_state == IPC_RECEIVING &&
+        (receiver->ipc_partner == IPC_ANY || receiver->ipc_partner == sender->pid);
+}
+
+static void deliver(struct task_t* receiver, int status, uint32_t m0, uint32_t m1) {
+    receiver->trap->eax = status;
+    receiver->trap->esi = m0;
+    receiver->trap->edi = m1;
+    receiver->ipc_state = IPC_NONE;
+}
+
+static void block() {
+    current_task->state = TASK_BLOCKED;
+    schedule();
+}
+
+static void do_send(int call) {
+    struct task_t* task = current_task;
+    struct trap_t* trap = task->trap;
+    struct task_t* receiver = find_task(trap->ebx);
+
+    if(!receiver || receiver == task || receiver->state == TASK_ZOMBIE) {
+        trap->eax = -1;
+        return;
+    }
+
+    task->ipc_partner = receiver->pid;
+    trap->eax = 0;
+
+    if(accepts(receiver, task)) {
+        deliver(receiver, task->pid, trap->esi, trap->edi);
+
+        if(call) {
+            task->ipc_state = IPC_WAIT_REPLY;
+            task->state = TASK_BLOCKED;
+        }
+
+        handoff(receiver);
+        return;
+    }
+
+    task->ipc_state = IPC_SENDING;
+    task->ipc_call = call;
+    task->ipc_message[0] = trap->esi;
+    task->ipc_message[1] = trap->edi;
+
+    struct wait_queue_t* queue = &receiver->ipc_senders;
+    task->wait_next = 0;
+
+    if(queue->tail)
+        queue->tail->wait_next = task;
+    else
+        queue->head = task;
+
+    queue->tail = task;
+
+    // the receiver (or the reply, for a call) fills in our frame
+    block();
+}
+
+// send(pid, m0, m1)
+void system_send() {
+    do_send(0);
+}
+
+// call(pid, m0, m1), the reply comes back in the same registers
+void system_call_ipc() {
+    do_send(1);
+}
+
+// recv(from), returns the sender pid with the message in esi/edi
+void system_recv() {
+    struct task_t* task = current_task;
+    struct trap_t* trap = task->trap;
+    int from = trap->ebx;
+
+    struct wait_queue_t* queue = &task->ipc_senders;
+    struct task_t* previous = 0;
+
+    for(struct task_t* sender = queue->head; sender; previous = sender, sender = sender->wait_next) {
+        if(from != IPC_ANY && sender->pid != from)
+            continue;
+
+        if(previous)
+            previous->wait_next = sender->wait_next;
+        else
+            queue->head = sender->wait_next;
+
+        if(queue->tail == sender)
+            queue->tail = previous;
+
+        sender->wait_next = 0;
+
+        deliver(task, sender->pid, sender->ipc_message[0], sender->ipc_message[1]);
+
+        if(sender->ipc_call) {
+            sender->ipc_state = IPC_WAIT_REPLY;
+        } else {
+            sender->ipc_state = IPC_NONE;
+            wake_task(sender);
+        }
+
+        return;
+    }
+
+    task->ipc_state = IPC_RECEIVING;
+    task->ipc_partner = from;
+    block();
+}
+
+// reply(pid, m0, m1) to a task blocked in call on us
+void system_reply() {
+    struct task_t* task = current_task;
+    struct trap_t* trap = task->trap;
+    struct task_t* caller = find_task(trap->ebx);
+
+    if(!caller || caller->ipc_state != IPC_WAIT_REPLY || caller->ipc_partner != task->pid) {
+        trap->eax = -1;
+        return;
+    }
+
+    deliver(caller, 0, trap->esi, trap->edi);
+    trap->eax = 0;
+
+    handoff(caller);
+}
+
+// fail everything blocked on a task that is going away
+void ipc_exit(struct task_t* task) {
+    struct task_t* sender = task->ipc_senders.head;
+
+    while(sender) {
+        struct task_t* next = sender->wait_next;
+        sender->wait_next = 0;
+        deliver(sender, -1, 0, 0);
+        wake_task(sender);
+        sender = next;
+    }
+
+    task->ipc_senders.head = 0;
+    task->ipc_senders.tail = 0;
+
+    for(struct task_t* other = task_list; other; other = other->list_next) {
+        if(other->ipc_partner != task->pid)
+            continue;
+
+        if(other->ipc_state == IPC_WAIT_REPLY || other->ipc_state == IPC_RECEIVING) {
+            deliver(other, -1, 0, 0);
+            wake_task(other);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include "syscall.h"
+
+#define IPC_NONE       0
+#define IPC_RECEIVING  1
+#define IPC_SENDING    2
+#define IPC_WAIT_REPLY 3
+
+#define IPC_ANY        -1
+
+/*
+ * synchronous message passing, a message is two words carried in %esi and
+ * %edi both ways, %ebx names the partner and %eax returns the status (or
+ * the sender pid for recv).
+ */
+static inline int ipc(int number, int pid, uint32_t* m0, uint32_t* m1) {
+    int ret;
+    __asm__ __volatile__ (
+        "    movl %%esp, %%ecx    \n"
+        "    leal 1f, %%edx       \n"
+        "    sysenter             \n"
+        "1:                       \n"
+        : "=a"(ret), "+S"(*m0), "+D"(*m1)
+        : "a"(number), "b"(pid)
+        : "ecx", "edx", "memory"
+    );
+    return ret;
+}
+
+static inline int ipc_send(int pid, uint32_t m0, uint32_t m1) {
+    return ipc(SYSTEM_send, pid, &m0, &m1);
+}
+
+// returns the sender pid, from may be IPC_ANY
+static inline int ipc_recv(int from, uint32_t* m0, uint32_t* m1) {
+    return ipc(SYSTEM_recv, from, m0, m1);
+}
+
+// send and wait for the reply, which overwrites the message
+static inline int ipc_call(int pid, uint32_t* m0, uint32_t* m1) {
+    return ipc(SYSTEM_call, pid, m0, m1);
+}
+
+static inline int ipc_reply(int pid, uint32_t m0, uint32_t m1) {
+    return ipc(SYSTEM_reply, pid, &m0, &m1);
+}
+
+struct task_t;
+void ipc_exit(struct task_t* task);
+
+#endif //IPC_H
@@ -3,6 +3,8 @@
 
 // descriptor.c
 void init_descriptor();
+void set_kernel_stack(uint32_t esp0);
+void set_double_fault_directory(uint32_t directory);
 
 // interrupt.c
 void init_interrupt_controller();
@@ -11,14 +13,48 @@ void init_interrupt_controller();
 void init_system_call();
 
 // timer.c
+#define TIMER_FREQUENCY 19 // scheduler ticks per second
 void init_timer(uint32_t frequency);
 
 // task.c
+struct trap_t;
 void init_tasking();
+void timer_callback(struct trap_t* trap);
+
+// fpu.c
+void init_fpu();
 
 // paging.c
 void init_paging(uint32_t max_memory);
 
+// string.c
+void init_string();
+
+// console.c
+void init_console();
+
+// keyboard.c
+void init_keyboard();
+
+// ata.c
+void init_ata();
+
+// buffer.c
+void init_buffer_cache();
+
+// fat.c
+void init_fat();
+
+// tmpfs.c
+void init_initrd(uint32_t start, uint32_t size);
+
+// serial.c
+void init_serial();
+void init_serial_interrupt();
+
+// trace.c
+void init_trace();
+
 // kprintf.c
 void kprintf(const char* fmt, ...);
 
@@ -0,0 +1,146 @@
+#include <stdint.h>
+
+#include "keyboard.h"
+#include "interrupt.h"
+#include "task.h"
+#include "asm.h"
+#include "kernel.h"
+
+#define KEYBOARD_DATA   0x60
+#define KEYBOARD_STATUS 0x64
+
+#define STATUS_OUTPUT   0x01
+
+#define KEY_RELEASE     0x80
+#define KEY_EXTENDED    0xe0
+#define KEY_LSHIFT      0x2a
+#define KEY_RSHIFT      0x36
+#define KEY_CTRL        0x1d
+#define KEY_CAPS        0x3a
+
+#define MOD_SHIFT       (1 << 0)
+#define MOD_CTRL        (1 << 1)
+#define MOD_CAPS        (1 << 2)
+
+// scancode set 1, us layout
+static const char keymap[128] = {
+    0, 27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
+    '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
+    0, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
+    0, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0,
+    '*', 0, ' ',
+};
+
+static const char keymap_shift[128] = {
+    0, 27, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
+    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
+    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',
+    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
+    '*', 0, ' ',
+};
+
+/*
+ * single producer/single consumer ring, the irq handler only moves head
+ * and readers only move tail. A reader sleeps while it is empty and the
+ * handler wakes it when the first character arrives.
+ */
+static char keyboard_buffer[KEYBOARD_BUFFER];
+static volatile uint32_t keyboard_head;
+static volatile uint32_t keyboard_tail;
+static struct wait_queue_t keyboard_wait;
+
+static int modifiers;
+static int extended;
+
+static char decode(uint8_t scancode) {
+    int released = scancode & KEY_RELEASE;
+    uint8_t key = scancode & ~KEY_RELEASE;
+
+    // only the modifiers of the extended keys matter here
+    if(extended) {
+        extended = 0;
+        if(key == KEY_CTRL)
+            modifiers = released ? modifiers & ~MOD_CTRL : modifiers | MOD_CTRL;
+        return 0;
+    }
+
+    switch(key) {
+    case KEY_LSHIFT:
+    case KEY_RSHIFT:
+        modifiers = released ? modifiers & ~MOD_SHIFT : modifiers | MOD_SHIFT;
+        return 0;
+
+    case KEY_CTRL:
+        modifiers = released ? modifiers & ~MOD_CTRL : modifiers | MOD_CTRL;
+        return 0;
+
+    case KEY_CAPS:
+        if(!released)
+            modifiers ^= MOD_CAPS;
+        return 0;
+    }
+
+    if(released)
+        return 0;
+
+    char ch = (modifiers & MOD_SHIFT) ? keymap_shift[key] : keymap[key];
+
+    if((modifiers & MOD_CAPS) && ch >= 'a' && ch <= 'z')
+        ch -= 'a' - 'A';
+    else if((modifiers & MOD_CAPS) && ch >= 'A' && ch <= 'Z')
+        ch += 'a' - 'A';
+
+    if((modifiers & MOD_CTRL) && ch >= '@' && ch <= '~')
+        ch &= 0x1f;
+
+    return ch;
+}
+
+static void keyboard_interrupt() {
+    uint32_t head = keyboard_head;
+    int was_empty = head == keyboard_tail;
+
+    while(inb(KEYBOARD_STATUS) & STATUS_OUTPUT) {
+        uint8_t scancode = inb(KEYBOARD_DATA);
+
+        if(scancode == KEY_EXTENDED) {
+            extended = 1;
+            continue;
+        }
+
+        char ch = decode(scancode);
+
+        // drop keys when nobody reads
+        if(ch && head - keyboard_tail < KEYBOARD_BUFFER)
+            keyboard_buffer[head++ & (KEYBOARD_BUFFER - 1)] = ch;
+    }
+
+    keyboard_head = head;
+
+    if(was_empty && head != keyboard_tail)
+        wake_up(&keyboard_wait);
+}
+
+// blocks until at least one character is typed
+int keyboard_read(char* buffer, size_t size) {
+    uint32_t flags = irq_save();
+    size_t count = 0;
+
+    while(keyboard_head == keyboard_tail)
+        sleep_on(&keyboard_wait);
+
+    uint32_t tail = keyboard_tail;
+
+    while(count < size && tail != keyboard_head)
+        buffer[count++] = keyboard_buffer[tail++ & (KEYBOARD_BUFFER - 1)];
+
+    keyboard_tail = tail;
+
+    irq_restore(flags);
+    return count;
+}
+
+void init_keyboard() {
+    register_interrupt_handler(IRQ0 + 1, &keyboard_interrupt);
+    enable_irq(IRQ0 + 1);
+}
@@ -0,0 +1,9 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+// decoded characters waiting for a reader, must be a power of two
+#define KEYBOARD_BUFFER 256
+
+int keyboard_read(char* buffer, size_t size);
+
+#endif //KEYBOARD_H
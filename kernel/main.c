@@ -3,38 +3,98 @@
 #include "asm.h"
 #include "syscall.h"
 #include "interrupt.h"
+#include "console.h"
+#include "file.h"
+#include "multiboot.h"
 #include "kernel.h"
 
 int fork() {
-    int ret;
-    __asm__ __volatile__ (
-        "int $0x80" : "=a"(ret) : "a"(SYSTEM_fork)
-    );
-    return ret;
+    return syscall(SYSTEM_fork, 0, 0, 0);
 }
 
 int getpid() {
-    int ret;
-    __asm__ __volatile__ (
-        "int $0x80" : "=a"(ret) : "a"(SYSTEM_getpid)
-    );
-    return ret;
+    return syscall(SYSTEM_getpid, 0, 0, 0);
 }
 
-void keyboard() {
-    uint8_t status = inb(0x64);
-    uint8_t data = inb(0x60);
-    kprintf("a key was pressed status: %d data: %d\n", status, data);
+void exit(int code) {
+    syscall(SYSTEM_exit, code, 0, 0);
 }
 
-int kmain() {
+int waitpid(int pid, int* status) {
+    return syscall(SYSTEM_waitpid, pid, (uint32_t)status, 0);
+}
+
+int clone(void (*entry)(void*), void* stack, void* arg) {
+    return syscall(SYSTEM_clone, (uint32_t)entry, (uint32_t)stack, (uint32_t)arg);
+}
+
+int pipe(int fds[2]) {
+    return syscall(SYSTEM_pipe, (uint32_t)fds, 0, 0);
+}
+
+int open(const char* path, int flags) {
+    return syscall(SYSTEM_open, (uint32_t)path, flags, 0);
+}
+
+int read(int fd, void* buffer, size_t size) {
+    return syscall(SYSTEM_read, fd, (uint32_t)buffer, size);
+}
+
+int write(int fd, const void* buffer, size_t size) {
+    return syscall(SYSTEM_write, fd, (uint32_t)buffer, size);
+}
+
+int close(int fd) {
+    return syscall(SYSTEM_close, fd, 0, 0);
+}
+
+int shm_create(uint32_t key, size_t size) {
+    return syscall(SYSTEM_shm_create, key, size, 0);
+}
+
+int shm_map(int fd, void* address) {
+    return syscall(SYSTEM_shm_map, fd, (uint32_t)address, 0);
+}
+
+int shm_unmap(void* address, size_t size) {
+    return syscall(SYSTEM_shm_unmap, (uint32_t)address, size, 0);
+}
+
+void* mmap(int fd, void* address, size_t size) {
+    return (void*)syscall(SYSTEM_mmap, fd, (uint32_t)address, size);
+}
+
+int munmap(void* address, size_t size) {
+    return syscall(SYSTEM_munmap, (uint32_t)address, size, 0);
+}
+
+int exec(const char* path, char* const argv[]) {
+    return syscall(SYSTEM_exec, (uint32_t)path, (uint32_t)argv, 0);
+}
+
+// magic and the loader registers, see parse_boot_info
+int kmain(uint32_t magic, uint32_t ebx, uint32_t edx) {
+    struct boot_info_t boot;
+
     cli();
+    parse_boot_info(magic, ebx, edx, &boot);
+    init_string();
+    init_console();
+    init_serial();
+    init_trace();
     init_descriptor();
     init_interrupt_controller();
-    init_paging(32*1024*1024);
+    init_paging(boot.memory);
     init_tasking();
+    init_fpu();
     init_system_call();
-    register_interrupt_handler(IRQ0 + 1, &keyboard);
+    init_serial_interrupt();
+    init_keyboard();
+    init_ata();
+    init_buffer_cache();
+    init_initrd(boot.initrd, boot.initrd_size);
+    init_fat();
+    open_console();
     sti();
 
     int pid;
@@ -45,13 +105,38 @@ int kmain() {
         //static int count = 0;
         while(1) {
             //kprintf("main %d\n", count++);
-            hlt();
+            // reap orphans handed to init, idle when there are no children
+            if(waitpid(-1, 0) < 0)
+                hlt();
         }
     } else {
-        while(1) {
-            //kprintf("Hi, I'm a child with pid: %d\n", getpid());
-            hlt();
+        char buffer[32];
+        int count;
+        int fd;
+        int child;
+
+        if((fd = open("/motd", O_RDONLY)) >= 0) {
+            while((count = read(fd, buffer, sizeof(buffer))) > 0)
+                write(1, buffer, count);
+
+            close(fd);
+        }
+
+        if((child = fork()) == 0) {
+            char* argv[] = { "/bin/hello", "from", "ring 3", 0 };
+
+            exec(argv[0], argv);
+            exit(1);
         }
+
+        waitpid(child, 0);
+
+        // echo what is typed
+        while((count = read(0, buffer, sizeof(buffer))) > 0)
+            write(1, buffer, count);
+
+        while(1)
+            hlt();
     }
 
     return 0;
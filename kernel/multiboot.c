@@ -0,0 +1,65 @@
+#include <stdint.h>
+
+#include "multiboot.h"
+#include "heap.h"
+#include "global.h"
+
+// memory usable from the kernel up, the available region it was loaded into
+static uint64_t memory_from_map(const struct multiboot_info_t* multiboot) {
+    uint32_t kernel = (uint32_t)__kernel_start;
+    uint32_t entry = multiboot->mmap_addr;
+
+    while(entry < multiboot->mmap_addr + multiboot->mmap_length) {
+        const struct multiboot_mmap_t* region = (const struct multiboot_mmap_t*)entry;
+
+        if(region->type == MULTIBOOT_MEMORY_AVAILABLE && region->base <= kernel &&
+           region->base + region->length > kernel)
+            return region->base + region->length;
+
+        entry += region->size + sizeof(region->size);
+    }
+
+    return BOOT_MEMORY;
+}
+
+/*
+ * boot/boot.S puts the initrd in low memory and passes it in %ebx and
+ * %edx. A multiboot loader passes its info structure in %ebx instead, the
+ * first module is the initrd. It sits right after the kernel, where the
+ * heap would start, so the heap is moved past it. Runs before anything is
+ * allocated.
+ */
+void parse_boot_info(uint32_t magic, uint32_t ebx, uint32_t edx, struct boot_info_t* info) {
+    info->memory = BOOT_MEMORY;
+    info->initrd = ebx;
+    info->initrd_size = edx;
+
+    if(magic != MULTIBOOT_BOOTLOADER_MAGIC)
+        return;
+
+    const struct multiboot_info_t* multiboot = (const struct multiboot_info_t*)ebx;
+    uint64_t memory = BOOT_MEMORY;
+
+    info->initrd = 0;
+    info->initrd_size = 0;
+
+    if(multiboot->flags & MULTIBOOT_INFO_MMAP)
+        memory = memory_from_map(multiboot);
+    else if(multiboot->flags & MULTIBOOT_INFO_MEMORY)
+        memory = 0x100000 + (uint64_t)multiboot->mem_upper * 1024;
+
+    if(memory > MAX_MEMORY)
+        memory = MAX_MEMORY;
+
+    info->memory = (uint32_t)memory & ~0xfff;
+
+    if((multiboot->flags & MULTIBOOT_INFO_MODS) && multiboot->mods_count) {
+        const struct multiboot_module_t* module = (const struct multiboot_module_t*)multiboot->mods_addr;
+
+        if(module->end <= info->memory) {
+            info->initrd = module->start;
+            info->initrd_size = module->end - module->start;
+            reserve_memory(module->end);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#define MULTIBOOT_HEADER_MAGIC     0x1badb002
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2badb002 // in %eax at entry
+
+// header flags
+#define MULTIBOOT_PAGE_ALIGN       (1 << 0) // modules on page boundaries
+#define MULTIBOOT_MEMORY_INFO      (1 << 1) // mem_* and mmap_* wanted
+
+// multiboot_info_t.flags
+#define MULTIBOOT_INFO_MEMORY      (1 << 0)
+#define MULTIBOOT_INFO_MODS        (1 << 3)
+#define MULTIBOOT_INFO_MMAP        (1 << 6)
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+#define BOOT_MEMORY (32 * 1024 * 1024)  // boot/boot.S doesn't tell
+#define MAX_MEMORY  (256 * 1024 * 1024) // all identity mapped, below USER_START
+
+#ifndef __ASSEMBLER__
+
+struct multiboot_info_t {
+    uint32_t flags;
+    uint32_t mem_lower; // KB
+    uint32_t mem_upper; // KB from 1MB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed));
+
+struct multiboot_module_t {
+    uint32_t start;
+    uint32_t end;
+    uint32_t string;
+    uint32_t reserved;
+} __attribute__((packed));
+
+// size doesn't count itself
+struct multiboot_mmap_t {
+    uint32_t size;
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed));
+
+// what the kernel needs from whoever loaded it
+struct boot_info_t {
+    uint32_t memory;
+    uint32_t initrd;
+    uint32_t initrd_size;
+};
+
+void parse_boot_info(uint32_t magic, uint32_t ebx, uint32_t edx, struct boot_info_t* info);
+
+#endif //__ASSEMBLER__
+
+#endif //MULTIBOOT_H
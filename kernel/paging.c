@@ -7,10 +7,11 @@
 #include "task.h"
 #include "asm.h"
 #include "global.h"
+#include "trace.h"
+#include "serial.h"
+#include "exec.h"
 #include "kernel.h"
 
-#define PAGE_SIZE    4096
-
 #define PRESENT      (1 << 0)
 #define READ         (1 << 1)
 #define USER         (1 << 2)
@@ -23,6 +24,8 @@
 #define AVAILABLE(x) ((x) << 9)
 #define ADDRESS(x)   ((x) & 0xfffff000)
 
+#define SHARED       AVAILABLE(1) // kept shared on fork, see map_frame
+
 #define IS_PROTECTION(x)  ((x) & (1 << 0))
 #define IS_NONPRESENT(x)  (!IS_PROTECTION(x))
 #define IS_WRITE(x)       ((x) & (1 << 1))
@@ -33,17 +36,57 @@
 struct pde_t* kernel_directory;
 struct pde_t* current_directory;
 
+// references on every frame handed out by alloc_frame, indexed by frame number
+static uint16_t* frame_refs = 0;
+static uint32_t frame_count = 0;
+
+// end of the identity map built by init_paging
+static uint32_t identity_end = 0;
+
+uint32_t alloc_frame() {
+    uint32_t frame = (uint32_t)kamalloc(PAGE_SIZE, 4096);
+
+    if(frame)
+        frame_refs[frame >> 12] = 1;
+
+    return frame;
+}
+
+void get_frame(uint32_t frame) {
+    uint32_t index = frame >> 12;
+
+    if(index < frame_count && frame_refs[index])
+        frame_refs[index]++;
+}
+
+// 0 for frames not from alloc_frame
+uint32_t frame_refcount(uint32_t frame) {
+    uint32_t index = frame >> 12;
+    return index < frame_count ? frame_refs[index] : 0;
+}
+
+// frames not from alloc_frame (identity mapped memory) are never freed
+void put_frame(uint32_t frame) {
+    uint32_t index = frame >> 12;
+
+    if(index >= frame_count || !frame_refs[index])
+        return;
+
+    if(--frame_refs[index] == 0)
+        kfree((void*)frame);
+}
+
 void alloc_page(uint32_t* page_table_entry) {
     if(ADDRESS(*page_table_entry) != 0)
         return;
 
-    uint32_t page = (uint32_t)kamalloc(PAGE_SIZE, 4096);
+    uint32_t page = alloc_frame();
     *page_table_entry |= PRESENT | READ | USER | page;
 }
 
 void free_page(uint32_t* page_table_entry) {
     uint32_t page = ADDRESS(*page_table_entry);
-    kfree((void*)page);
+    put_frame(page);
     *page_table_entry = 0;
 }
 
@@ -60,7 +103,7 @@ uint32_t* get_page_entry(struct pde_t* directory, uint32_t address, int create_p
     if(create_page) {
         struct pte_t* page_table = (struct pte_t*)kamalloc(sizeof(struct pte_t), 4096);
 
-        memset(page_table, 0, sizeof(struct pte_t));
+        clear_page(page_table);
         directory->tables[table_index] = PRESENT | READ | USER | (uint32_t)page_table; 
 
         return &page_table->pages[page_index];
@@ -80,41 +123,110 @@ int remap(struct pde_t* directory, uint32_t physical, uint32_t virtual) {
     return 1;
 }
 
-static void enable_paging() {
-    uint32_t cr0;
-    __asm__ __volatile__ ("movl %%cr0, %0" : "=r"(cr0));
-    __asm__ __volatile__ ("movl %0, %%cr0" : : "r"(cr0 | 0x80000000));
+// leave the frame in the entry but drop PRESENT, remap() brings it back
+void unmap_page(struct pde_t* directory, uint32_t address) {
+    uint32_t* page_entry = get_page_entry(directory, address, 0);
+
+    if(page_entry) {
+        *page_entry &= ~PRESENT;
+        invlpg(address);
+    }
 }
 
-static void disable_paging() {
+// the identity mapped kernel memory and its tables, shared by every address
+// space, are off limits to map_frame/unmap_frame
+static int is_kernel_page(struct pde_t* directory, uint32_t address) {
+    uint32_t table = ADDRESS(directory->tables[address >> 22]);
+
+    if(directory == kernel_directory)
+        return address < identity_end;
+
+    return table && table == ADDRESS(kernel_directory->tables[address >> 22]);
+}
+
+/*
+ * map a frame at address taking a reference on it, fails on a page already
+ * in use. A MAP_SHARED mapping survives fork as the same frame instead of a
+ * copy, so does a MAP_READONLY one since nobody can change it.
+ */
+int map_frame(struct pde_t* directory, uint32_t address, uint32_t frame, int flags) {
+    if(is_kernel_page(directory, address))
+        return -1;
+
+    uint32_t* page_entry = get_page_entry(directory, address, 1);
+
+    if(!page_entry || ADDRESS(*page_entry))
+        return -1;
+
+    get_frame(frame);
+    *page_entry = PRESENT | USER | ADDRESS(frame);
+
+    if(flags & MAP_SHARED)
+        *page_entry |= SHARED;
+
+    if(!(flags & MAP_READONLY))
+        *page_entry |= READ;
+
+    return 0;
+}
+
+// undo map_frame, dropping the reference the mapping held
+void unmap_frame(struct pde_t* directory, uint32_t address) {
+    if(is_kernel_page(directory, address))
+        return;
+
+    uint32_t* page_entry = get_page_entry(directory, address, 0);
+
+    if(!page_entry || !ADDRESS(*page_entry))
+        return;
+
+    free_page(page_entry);
+
+    if(directory == current_directory)
+        invlpg(address);
+}
+
+int is_page_present(struct pde_t* directory, uint32_t address) {
+    uint32_t* page_entry = get_page_entry(directory, address, 0);
+    return page_entry && (*page_entry & PRESENT);
+}
+
+int is_page_writable(struct pde_t* directory, uint32_t address) {
+    uint32_t* page_entry = get_page_entry(directory, address, 0);
+    return page_entry && (*page_entry & (PRESENT | READ)) == (PRESENT | READ);
+}
+
+// wp makes the kernel honour read only pages too, they may be shared page cache
+static void enable_paging() {
     uint32_t cr0;
     __asm__ __volatile__ ("movl %%cr0, %0" : "=r"(cr0));
-    __asm__ __volatile__ ("movl %0, %%cr0" : : "r"(cr0 & 0x7fffffff));
+    __asm__ __volatile__ ("movl %0, %%cr0" : : "r"(cr0 | 0x80010000));
 }
 
 void switch_page_directory(struct pde_t* directory) {
-    __asm__ __volatile__ ("movl %0, %%cr3" : : "r"(directory));
+    __asm__ __volatile__ ("movl %0, %%cr3" : : "r"(directory) : "memory");
     current_directory = directory;
-
-    enable_paging();
 }
 
 struct pte_t* clone_page_table(const struct pte_t* page) {
     struct pte_t* new_page = (struct pte_t*)kamalloc(sizeof(struct pte_t), 4096);
-    memset(new_page, 0, sizeof(struct pte_t)); 
+    clear_page(new_page);
 
     for(int i = 0; i < 1024; i++) {
         if(!ADDRESS(page->pages[i]))
             continue;
 
+        if((page->pages[i] & SHARED) || !(page->pages[i] & READ)) {
+            new_page->pages[i] = page->pages[i];
+            get_frame(ADDRESS(page->pages[i]));
+            continue;
+        }
+
         alloc_page(&new_page->pages[i]);
         new_page->pages[i] |= (page->pages[i] & 0xfff);
 
-        cli();
-        disable_paging();
-        memcpy((void*)ADDRESS(new_page->pages[i]), (void*)ADDRESS(page->pages[i]), PAGE_SIZE);
-        enable_paging();
-        sti();
+        // frames are identity mapped, no need to turn paging off
+        copy_page((void*)ADDRESS(new_page->pages[i]), (void*)ADDRESS(page->pages[i]));
     }
 
     return new_page;
@@ -122,7 +234,7 @@ struct pte_t* clone_page_table(const struct pte_t* page) {
 
 struct pde_t* clone_page_directory(const struct pde_t* directory) {
     struct pde_t* new_directory = kamalloc(sizeof(struct pde_t), 4096);
-    memset(new_directory, 0, sizeof(struct pde_t));
+    clear_page(new_directory);
 
     for(int i = 0; i < 1024; i++) {
         if(!directory->tables[i])
@@ -139,6 +251,27 @@ struct pde_t* clone_page_directory(const struct pde_t* directory) {
     return new_directory;
 }
 
+// every table not shared with the kernel directory goes, with its frames
+void free_page_directory(struct pde_t* directory) {
+    for(int i = 0; i < 1024; i++) {
+        uint32_t table = ADDRESS(directory->tables[i]);
+
+        if(!table || table == ADDRESS(kernel_directory->tables[i]))
+            continue;
+
+        struct pte_t* page_table = (struct pte_t*)table;
+
+        for(int j = 0; j < 1024; j++) {
+            if(ADDRESS(page_table->pages[j]))
+                free_page(&page_table->pages[j]);
+        }
+
+        kfree(page_table);
+    }
+
+    kfree(directory);
+}
+
 uint32_t get_mapping(struct pde_t* directory, uint32_t address) {
     uint32_t table_index = (address >> 22) & 0x3ff;
     uint32_t page_index = (address >> 12) & 0x3ff;
@@ -157,14 +290,24 @@ uint32_t get_mapping(struct pde_t* directory, uint32_t address) {
     return ADDRESS(page_entry) | frame_index;
 }
 
-void page_fault_handler() {
+void page_fault_handler(struct trap_t* frame) {
     uint32_t address;
 
     __asm__ __volatile__ ("movl %%cr2, %0" : "=r"(address));
 
-    kprintf("A page fault was caught at address 0x%x\n", address);
+    trace(TRACE_PAGE_FAULT, address, frame->error_code, frame->eip, 0);
 
-    struct trap_t* frame = current_task->trap;
+    // demand paging, also for the kernel touching user memory in a system call
+    if(IS_NONPRESENT(frame->error_code) && vma_fault(address) == 0)
+        return;
+
+    // a user fault, or a system call handed bad user memory
+    if((frame->cs & 0x3) || address >= USER_START) {
+        kprintf("pid %d: page fault at 0x%x, eip 0x%x\n", current_task->pid, address, frame->eip);
+        do_exit(-1);
+    }
+
+    kprintf("A page fault was caught at address 0x%x\n", address);
 
     if(IS_PROTECTION(frame->error_code))
         kprintf("The fault was caused by a page-level protection violation\n");
@@ -187,6 +330,8 @@ void page_fault_handler() {
     if(IS_INSTRUCTION(frame->error_code))
         kprintf("The fault was caused by an instruction fetch\n");
 
+    serial_sync();
+
     while(1)
         hlt();
 }
@@ -194,8 +339,13 @@ void page_fault_handler() {
 void init_paging(uint32_t max_memory) {
     init_kernel_heap(max_memory);
 
+    identity_end = max_memory;
+    frame_count = max_memory / PAGE_SIZE;
+    frame_refs = (uint16_t*)kmalloc(frame_count * sizeof(uint16_t));
+    memset(frame_refs, 0, frame_count * sizeof(uint16_t));
+
     kernel_directory = (struct pde_t*)kamalloc(sizeof(struct pde_t), 4096);
-    memset(kernel_directory, 0, sizeof(struct pde_t));
+    clear_page(kernel_directory);
 
     for(uint32_t ptr = 0; ptr < max_memory; ptr += PAGE_SIZE) {
         remap(kernel_directory, ptr, ptr);
@@ -203,5 +353,7 @@ void init_paging(uint32_t max_memory) {
 
     register_interrupt_handler(14, &page_fault_handler);
     switch_page_directory(kernel_directory);
+    enable_paging();
+    set_double_fault_directory((uint32_t)kernel_directory);
 }
 
@@ -9,9 +9,29 @@ struct pde_t {
     uint32_t tables[1024];
 };
 
+#define PAGE_SIZE 4096
+
+// map_frame flags
+#define MAP_SHARED   1
+#define MAP_READONLY 2
+
+uint32_t alloc_frame();
+void get_frame(uint32_t frame);
+void put_frame(uint32_t frame);
+uint32_t frame_refcount(uint32_t frame);
+
+uint32_t* get_page_entry(struct pde_t* directory, uint32_t address, int create_page);
+int map_frame(struct pde_t* directory, uint32_t address, uint32_t frame, int flags);
+void unmap_frame(struct pde_t* directory, uint32_t address);
+
 void switch_page_directory(struct pde_t* directory);
 struct pde_t* clone_page_directory(const struct pde_t* directory);
+void free_page_directory(struct pde_t* directory);
 uint32_t get_mapping(struct pde_t* directory, uint32_t address);
+int remap(struct pde_t* directory, uint32_t physical, uint32_t virtual);
+void unmap_page(struct pde_t* directory, uint32_t address);
+int is_page_present(struct pde_t* directory, uint32_t address);
+int is_page_writable(struct pde_t* directory, uint32_t address);
 
 #endif //PAGING_H
 
@@ -0,0 +1,43 @@
+#include <stdint.h>
+
+#include "pci.h"
+#include "asm.h"
+
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA    0xcfc
+#define PCI_ENABLE         0x80000000
+
+// configuration mechanism #1, offsets are dword aligned
+uint32_t pci_read(pci_device_t device, int offset) {
+    outl(PCI_CONFIG_ADDRESS, PCI_ENABLE | device | (offset & 0xfc));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write(pci_device_t device, int offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, PCI_ENABLE | device | (offset & 0xfc));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// first function with the class code, brute force over every slot
+pci_device_t pci_find_class(uint8_t class, uint8_t subclass) {
+    for(int bus = 0; bus < 256; bus++) {
+        for(int slot = 0; slot < 32; slot++) {
+            for(int function = 0; function < 8; function++) {
+                pci_device_t device = PCI_DEVICE(bus, slot, function);
+
+                if((pci_read(device, PCI_VENDOR) & 0xffff) == 0xffff) {
+                    if(function == 0)
+                        break;
+                    continue;
+                }
+
+                uint32_t code = pci_read(device, PCI_CLASS);
+
+                if((code >> 24) == class && ((code >> 16) & 0xff) == subclass)
+                    return device;
+            }
+        }
+    }
+
+    return PCI_NONE;
+}
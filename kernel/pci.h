@@ -0,0 +1,29 @@
+#ifndef PCI_H
+#define PCI_H
+
+#define PCI_VENDOR     0x00
+#define PCI_COMMAND    0x04
+#define PCI_CLASS      0x08 // revision, prog if, subclass, class
+#define PCI_BAR0       0x10
+#define PCI_BAR4       0x20
+#define PCI_INTERRUPT  0x3c
+
+#define PCI_COMMAND_IO     (1 << 0)
+#define PCI_COMMAND_MEMORY (1 << 1)
+#define PCI_COMMAND_MASTER (1 << 2)
+
+#define PCI_BAR_IO     (1 << 0)
+
+// bus, device and function packed as in a config address
+typedef uint32_t pci_device_t;
+
+#define PCI_DEVICE(bus, device, function) \
+    (((bus) << 16) | ((device) << 11) | ((function) << 8))
+
+#define PCI_NONE 0xffffffff
+
+uint32_t pci_read(pci_device_t device, int offset);
+void pci_write(pci_device_t device, int offset, uint32_t value);
+pci_device_t pci_find_class(uint8_t class, uint8_t subclass);
+
+#endif //PCI_H
@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "file.h"
+#include "task.h"
+#include "heap.h"
+#include "exec.h"
+#include "asm.h"
+#include "global.h"
+
+#define PIPE_SIZE 4096
+#define PIPE_MASK (PIPE_SIZE - 1)
+
+#define barrier() __asm__ __volatile__ ("" : : : "memory")
+
+/*
+ * single producer/single consumer ring
+ *
+ * head is only written by the writer and tail only by the reader, both run
+ * freely and are masked on access, head - tail is the amount buffered.
+ * Sleepers are only woken on the edges, a reader when the pipe stops being
+ * empty and a writer when it stops being full. The copies run with
+ * interrupts on and may fault in user pages, the checks against the other
+ * end and the sleeps don't. Tasks sharing an end after fork take turns
+ * through the end's lock, so there is one producer and one consumer.
+ */
+struct pipe_t {
+    uint8_t* buffer;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    int readers;
+    int writers;
+    struct wait_queue_t read_wait;
+    struct wait_queue_t write_wait;
+    struct lock_t read_lock;
+    struct lock_t write_lock;
+};
+
+static int pipe_read(struct file_t* file, void* buffer, size_t size) {
+    struct pipe_t* pipe = (struct pipe_t*)file->data;
+    uint32_t head;
+
+    lock(&pipe->read_lock);
+    uint32_t flags = irq_save();
+
+    while((head = pipe->head) == pipe->tail) {
+        if(!pipe->writers) {
+            irq_restore(flags);
+            unlock(&pipe->read_lock);
+            return 0;
+        }
+
+        sleep_on(&pipe->read_wait);
+    }
+
+    irq_restore(flags);
+    barrier();
+
+    uint32_t tail = pipe->tail;
+    uint32_t count = head - tail;
+    if(count > size)
+        count = size;
+
+    uint32_t offset = tail & PIPE_MASK;
+    uint32_t first = PIPE_SIZE - offset;
+    if(first > count)
+        first = count;
+
+    memcpy(buffer, pipe->buffer + offset, first);
+    memcpy((uint8_t*)buffer + first, pipe->buffer, count - first);
+
+    flags = irq_save();
+    pipe->tail = tail + count;
+
+    // a writer sleeps on a full pipe, it may have filled it during the copy
+    if(pipe->head - tail == PIPE_SIZE)
+        wake_up(&pipe->write_wait);
+
+    irq_restore(flags);
+    unlock(&pipe->read_lock);
+    return count;
+}
+
+static int pipe_write(struct file_t* file, const void* buffer, size_t size) {
+    struct pipe_t* pipe = (struct pipe_t*)file->data;
+    const uint8_t* data = (const uint8_t*)buffer;
+    size_t written = 0;
+
+    lock(&pipe->write_lock);
+
+    while(written < size) {
+        uint32_t flags = irq_save();
+
+        while(pipe->readers && pipe->head - pipe->tail == PIPE_SIZE)
+            sleep_on(&pipe->write_wait);
+
+        irq_restore(flags);
+
+        if(!pipe->readers) {
+            unlock(&pipe->write_lock);
+            return written ? (int)written : -1;
+        }
+
+        uint32_t head = pipe->head;
+        uint32_t space = PIPE_SIZE - (head - pipe->tail);
+
+        barrier();
+
+        uint32_t count = size - written;
+        if(count > space)
+            count = space;
+
+        uint32_t offset = head & PIPE_MASK;
+        uint32_t first = PIPE_SIZE - offset;
+        if(first > count)
+            first = count;
+
+        memcpy(pipe->buffer + offset, data + written, first);
+        memcpy(pipe->buffer, data + written + first, count - first);
+
+        flags = irq_save();
+        pipe->head = head + count;
+        written += count;
+
+        // a reader sleeps on an empty pipe, it may have drained it during the copy
+        if(pipe->tail == head)
+            wake_up(&pipe->read_wait);
+
+        irq_restore(flags);
+    }
+
+    unlock(&pipe->write_lock);
+    return written;
+}
+
+static void pipe_release(struct pipe_t* pipe) {
+    if(pipe->readers || pipe->writers)
+        return;
+
+    kfree(pipe->buffer);
+    kfree(pipe);
+}
+
+static void pipe_close_read(struct file_t* file) {
+    struct pipe_t* pipe = (struct pipe_t*)file->data;
+
+    pipe->readers--;
+    wake_up(&pipe->write_wait);
+    pipe_release(pipe);
+}
+
+static void pipe_close_write(struct file_t* file) {
+    struct pipe_t* pipe = (struct pipe_t*)file->data;
+
+    pipe->writers--;
+    wake_up(&pipe->read_wait);
+    pipe_release(pipe);
+}
+
+static const struct file_ops_t pipe_read_ops = {
+    .read = pipe_read,
+    .close = pipe_close_read,
+};
+
+static const struct file_ops_t pipe_write_ops = {
+    .write = pipe_write,
+    .close = pipe_close_write,
+};
+
+// pipe(int fds[2]), fds[0] is the read end
+void system_pipe() {
+    struct trap_t* trap = current_task->trap;
+    int* fds = (int*)trap->ebx;
+
+    if(!user_writable(trap->ebx, 2 * sizeof(int))) {
+        trap->eax = -1;
+        return;
+    }
+
+    struct pipe_t* pipe = (struct pipe_t*)kmalloc(sizeof(struct pipe_t));
+    memset(pipe, 0, sizeof(struct pipe_t));
+    pipe->buffer = (uint8_t*)kamalloc(PIPE_SIZE, 4096);
+    pipe->readers = 1;
+    pipe->writers = 1;
+
+    struct file_t* reader = alloc_file(&pipe_read_ops, pipe, FILE_READ);
+    struct file_t* writer = alloc_file(&pipe_write_ops, pipe, FILE_WRITE);
+
+    fds[0] = install_file(reader);
+    fds[1] = install_file(writer);
+
+    if(fds[0] < 0 || fds[1] < 0) {
+        if(fds[0] >= 0) current_task->files[fds[0]] = 0;
+        if(fds[1] >= 0) current_task->files[fds[1]] = 0;
+
+        file_put(reader);
+        file_put(writer);
+
+        trap->eax = -1;
+        return;
+    }
+
+    trap->eax = 0;
+}
@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "profile.h"
+#include "serial.h"
+#include "task.h"
+#include "heap.h"
+#include "asm.h"
+#include "global.h"
+#include "kernel.h"
+
+/*
+ * statistical profiler
+ *
+ * every timer tick adds one hit to the counter of the interrupted kernel
+ * eip, ticks from user mode are only counted. The timer is sped up by
+ * PROFILE_MULTIPLIER while profiling and profile_tick() tells the caller
+ * which ticks still belong to the scheduler. tools/profile.py symbolizes
+ * a dump against bin/kernel.elf.
+ */
+
+static uint32_t* profile_buckets;
+static uint32_t profile_size;
+static uint32_t profile_samples;
+static uint32_t profile_user;
+static uint32_t profile_ticks;
+static uint32_t profile_flags;
+static int profiling;
+
+static uint32_t profile_chains[PROFILE_CHAINS][PROFILE_DEPTH];
+static uint32_t profile_chain_count;
+
+// follow the saved ebp links while they stay on the task's kernel stack
+static void profile_callchain(struct trap_t* trap) {
+    uint32_t* chain = profile_chains[profile_chain_count++ % PROFILE_CHAINS];
+    uint32_t bottom = (uint32_t)current_task->stack;
+    uint32_t top = current_task->esp0;
+    uint32_t frame = trap->ebp;
+    int depth = 0;
+
+    chain[depth++] = trap->eip;
+
+    while(depth < PROFILE_DEPTH && frame >= bottom && frame + 8 <= top) {
+        uint32_t* words = (uint32_t*)frame;
+
+        chain[depth++] = words[1];
+
+        if(words[0] <= frame)
+            break;
+
+        frame = words[0];
+    }
+
+    while(depth < PROFILE_DEPTH)
+        chain[depth++] = 0;
+}
+
+// returns 1 when the scheduler should see this tick
+int profile_tick(struct trap_t* trap) {
+    if(!profiling)
+        return 1;
+
+    profile_samples++;
+
+    if((trap->cs & 3) != 0) {
+        profile_user++;
+    } else {
+        uint32_t bucket = (trap->eip - (uint32_t)__text_start) >> PROFILE_SHIFT;
+
+        if(bucket < profile_size)
+            profile_buckets[bucket]++;
+
+        if(profile_flags & PROFILE_CALLCHAIN)
+            profile_callchain(trap);
+    }
+
+    if(++profile_ticks < PROFILE_MULTIPLIER)
+        return 0;
+
+    profile_ticks = 0;
+    return 1;
+}
+
+static void profile_reset() {
+    if(profile_buckets)
+        memset(profile_buckets, 0, profile_size * sizeof(uint32_t));
+
+    memset(profile_chains, 0, sizeof(profile_chains));
+    profile_chain_count = 0;
+    profile_samples = 0;
+    profile_user = 0;
+}
+
+static int profile_start(uint32_t flags) {
+    if(!profile_buckets) {
+        profile_size = ((uint32_t)__text_end - (uint32_t)__text_start) >> PROFILE_SHIFT;
+        profile_buckets = (uint32_t*)kmalloc(profile_size * sizeof(uint32_t));
+
+        if(!profile_buckets)
+            return -1;
+
+        memset(profile_buckets, 0, profile_size * sizeof(uint32_t));
+    }
+
+    profile_flags = flags;
+    profile_ticks = 0;
+    profiling = 1;
+    init_timer(TIMER_FREQUENCY * PROFILE_MULTIPLIER);
+    return 0;
+}
+
+static void profile_stop() {
+    if(!profiling)
+        return;
+
+    profiling = 0;
+    init_timer(TIMER_FREQUENCY);
+}
+
+/*
+ * "profile <text start> <shift> <samples> <user samples>", then an
+ * "<address> <hits>" line per non empty counter and a "chain <eip>..."
+ * line per call chain, all in hex, and "end"
+ */
+static void profile_dump() {
+    serial_write("profile ", 8);
+    serial_hex((uint32_t)__text_start);
+    serial_putc(' ');
+    serial_hex(PROFILE_SHIFT);
+    serial_putc(' ');
+    serial_hex(profile_samples);
+    serial_putc(' ');
+    serial_hex(profile_user);
+    serial_putc('\n');
+
+    for(uint32_t i = 0; profile_buckets && i < profile_size; i++) {
+        if(!profile_buckets[i])
+            continue;
+
+        serial_hex((uint32_t)__text_start + (i << PROFILE_SHIFT));
+        serial_putc(' ');
+        serial_hex(profile_buckets[i]);
+        serial_putc('\n');
+    }
+
+    uint32_t chains = profile_chain_count < PROFILE_CHAINS ? profile_chain_count : PROFILE_CHAINS;
+
+    for(uint32_t i = 0; i < chains; i++) {
+        serial_write("chain", 5);
+
+        for(int depth = 0; depth < PROFILE_DEPTH && profile_chains[i][depth]; depth++) {
+            serial_putc(' ');
+            serial_hex(profile_chains[i][depth]);
+        }
+
+        serial_putc('\n');
+    }
+
+    serial_write("end\n", 4);
+}
+
+void system_profile() {
+    struct trap_t* trap = current_task->trap;
+    int ret = 0;
+
+    switch(trap->ebx) {
+    case PROFILE_START:
+        ret = profile_start(trap->esi);
+        break;
+
+    case PROFILE_STOP:
+        profile_stop();
+        break;
+
+    case PROFILE_RESET:
+        profile_reset();
+        break;
+
+    case PROFILE_DUMP: {
+        // samples taken while printing would only show the serial loop
+        int was_profiling = profiling;
+        profiling = 0;
+        profile_dump();
+        profiling = was_profiling;
+        break;
+    }
+
+    default:
+        ret = -1;
+        break;
+    }
+
+    trap->eax = ret;
+}
@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "syscall.h"
+
+// system call commands
+#define PROFILE_START 0 // flags in the argument
+#define PROFILE_STOP  1
+#define PROFILE_RESET 2
+#define PROFILE_DUMP  3
+
+// start flags
+#define PROFILE_CALLCHAIN (1 << 0)
+
+// histogram granularity, one counter per 1 << PROFILE_SHIFT bytes of .text
+#define PROFILE_SHIFT      2
+// the timer runs this many times faster while profiling
+#define PROFILE_MULTIPLIER 50
+// frame pointer call chains, kept in a ring
+#define PROFILE_CHAINS     256
+#define PROFILE_DEPTH      8
+
+struct trap_t;
+
+int profile_tick(struct trap_t* trap);
+
+static inline int profile_control(int command, uint32_t flags) {
+    return syscall(SYSTEM_profile, command, flags, 0);
+}
+
+#endif //PROFILE_H
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "ring.h"
+#include "syscall.h"
+#include "task.h"
+#include "paging.h"
+#include "global.h"
+
+// syscall.c
+int do_system_call(uint32_t number, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+// calls that need the real trap frame of the task can't be batched,
+// the ipc ones hand their message back in esi and edi
+static int is_batchable(uint32_t number) {
+    switch(number) {
+    case SYSTEM_fork:
+    case SYSTEM_exit:
+    case SYSTEM_clone:
+    case SYSTEM_exec:
+    case SYSTEM_recv:
+    case SYSTEM_call:
+    case SYSTEM_reply:
+    case SYSTEM_ring_setup:
+    case SYSTEM_ring_enter:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * ring_setup(address), maps the task's ring at a page aligned user address
+ * and returns it. The ring is a frame of its own mapped into this task only,
+ * the kernel keeps a reference and reaches it through the identity map, so
+ * the task unmapping it doesn't pull it from under ring_enter.
+ */
+void system_ring_setup() {
+    struct task_t* task = current_task;
+    struct trap_t* trap = task->trap;
+    uint32_t address = trap->ebx;
+    uint32_t frame = 0;
+
+    if(task->ring) {
+        trap->eax = task->ring_address;
+        return;
+    }
+
+    // kernel threads have no address space of their own to map it into
+    if(!task->page_directory || (address & (PAGE_SIZE - 1)) || !(frame = alloc_frame()) ||
+       map_frame(task->page_directory, address, frame, 0) != 0) {
+        if(frame)
+            put_frame(frame);
+        trap->eax = -1;
+        return;
+    }
+
+    memset((void*)frame, 0, PAGE_SIZE);
+    task->ring = (struct syscall_ring_t*)frame;
+    task->ring_address = address;
+    trap->eax = address;
+}
+
+// drops the ring on exit and exec, the page is only unmapped if it still holds it
+void ring_release(struct task_t* task) {
+    if(!task->ring)
+        return;
+
+    uint32_t frame = (uint32_t)task->ring;
+    uint32_t* page_entry = task->page_directory ? get_page_entry(task->page_directory, task->ring_address, 0) : 0;
+
+    if(page_entry && (*page_entry & 0xfffff000) == frame)
+        unmap_frame(task->page_directory, task->ring_address);
+
+    put_frame(frame);
+    task->ring = 0;
+}
+
+// process up to ebx submissions, returns how many were consumed
+void system_ring_enter() {
+    struct trap_t* trap = current_task->trap;
+    struct syscall_ring_t* ring = current_task->ring;
+    uint32_t to_submit = trap->ebx;
+    uint32_t done = 0;
+
+    if(!ring) {
+        trap->eax = -1;
+        return;
+    }
+
+    uint32_t head = ring->sq_head;
+    uint32_t tail = ring->sq_tail;
+    uint32_t cq_tail = ring->cq_tail;
+
+    barrier();
+
+    while(done < to_submit && head != tail) {
+        // leave the rest queued until the task reaps completions
+        if(cq_tail - ring->cq_head >= RING_ENTRIES)
+            break;
+
+        struct submission_t* sqe = &ring->sq[head & RING_MASK];
+        struct completion_t* cqe = &ring->cq[cq_tail & RING_MASK];
+
+        cqe->user_data = sqe->user_data;
+
+        if(is_batchable(sqe->number))
+            cqe->result = do_system_call(sqe->number, sqe->args[0], sqe->args[1], sqe->args[2]);
+        else
+            cqe->result = -1;
+
+        head++;
+        cq_tail++;
+        done++;
+    }
+
+    barrier();
+    ring->sq_head = head;
+    ring->cq_tail = cq_tail;
+
+    trap->eax = done;
+}
@@ -0,0 +1,75 @@
+#ifndef RING_H
+#define RING_H
+
+/*
+ * system call ring, shared between a task and the kernel
+ *
+ * the task writes submissions at sq_tail and reads completions at cq_head,
+ * the kernel consumes submissions at sq_head and posts completions at
+ * cq_tail from SYSTEM_ring_enter. Indexes run freely and are masked with
+ * RING_MASK, each side only writes its own index.
+ */
+
+#define RING_ENTRIES 64
+#define RING_MASK    (RING_ENTRIES - 1)
+
+#define barrier() __asm__ __volatile__ ("" : : : "memory")
+
+struct submission_t {
+    uint32_t number;
+    uint32_t args[3];
+    uint32_t user_data;
+};
+
+struct completion_t {
+    uint32_t user_data;
+    int32_t result;
+};
+
+struct syscall_ring_t {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    struct submission_t sq[RING_ENTRIES];
+    struct completion_t cq[RING_ENTRIES];
+};
+
+struct task_t;
+
+void ring_release(struct task_t* task);
+
+static inline int ring_submit(struct syscall_ring_t* ring, uint32_t number,
+        uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t user_data) {
+    uint32_t tail = ring->sq_tail;
+
+    if(tail - ring->sq_head >= RING_ENTRIES)
+        return -1;
+
+    struct submission_t* sqe = &ring->sq[tail & RING_MASK];
+    sqe->number = number;
+    sqe->args[0] = arg0;
+    sqe->args[1] = arg1;
+    sqe->args[2] = arg2;
+    sqe->user_data = user_data;
+
+    barrier();
+    ring->sq_tail = tail + 1;
+    return 0;
+}
+
+static inline int ring_complete(struct syscall_ring_t* ring, struct completion_t* cqe) {
+    uint32_t head = ring->cq_head;
+
+    if(head == ring->cq_tail)
+        return -1;
+
+    barrier();
+    *cqe = ring->cq[head & RING_MASK];
+
+    barrier();
+    ring->cq_head = head + 1;
+    return 0;
+}
+
+#endif //RING_H
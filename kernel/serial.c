@@ -0,0 +1,215 @@
+#include <stdint.h>
+
+#include "serial.h"
+#include "interrupt.h"
+#include "task.h"
+#include "asm.h"
+#include "kernel.h"
+
+#define DATA          0
+#define INTERRUPT     1
+#define DIVISOR_LOW   0
+#define DIVISOR_HIGH  1
+#define FIFO          2 // write
+#define IDENTIFY      2 // read
+#define LINE_CONTROL  3
+#define MODEM_CONTROL 4
+#define LINE_STATUS   5
+#define MODEM_STATUS  6
+
+#define INTERRUPT_RX  0x01
+#define INTERRUPT_TX  0x02
+
+#define IDENTIFY_NONE 0x01
+#define IDENTIFY_MASK 0x0e
+#define IDENTIFY_TX   0x02
+#define IDENTIFY_RX   0x04
+#define IDENTIFY_LINE 0x06
+#define IDENTIFY_TIMEOUT 0x0c
+
+#define FIFO_ENABLE   0x01
+#define FIFO_CLEAR    0x06
+#define FIFO_TRIGGER8 0x80
+
+#define LINE_DLAB     0x80
+#define LINE_8N1      0x03
+
+#define MODEM_DTR     0x01
+#define MODEM_RTS     0x02
+#define MODEM_OUT2    0x08 // gates the irq line to the pic
+
+#define STATUS_READY  0x01
+#define STATUS_EMPTY  0x20
+
+#define FIFO_SIZE     16
+#define SERIAL_IRQ    (IRQ0 + 4)
+
+#define TX_SIZE 4096
+#define RX_SIZE 256
+
+/*
+ * 16550 on COM1
+ *
+ * writers only queue bytes in the transmit ring, the transmitter empty
+ * interrupt moves them to the uart a fifo (16 bytes) at a time and is
+ * turned off when the ring runs dry. A writer that finds the ring full
+ * feeds the fifo itself. Received bytes are queued by the irq handler for
+ * serial_read.
+ */
+static char tx_buffer[TX_SIZE];
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+static int tx_running;
+
+static char rx_buffer[RX_SIZE];
+static volatile uint32_t rx_head;
+static volatile uint32_t rx_tail;
+static struct wait_queue_t rx_wait;
+
+static int serial_ready;
+
+// called with interrupts disabled and the transmitter empty
+static void tx_fill() {
+    for(int i = 0; i < FIFO_SIZE && tx_tail != tx_head; i++)
+        outb(COM1 + DATA, tx_buffer[tx_tail++ & (TX_SIZE - 1)]);
+}
+
+static void tx_start() {
+    if(tx_running)
+        return;
+
+    if(inb(COM1 + LINE_STATUS) & STATUS_EMPTY)
+        tx_fill();
+
+    tx_running = 1;
+    outb(COM1 + INTERRUPT, INTERRUPT_RX | INTERRUPT_TX);
+}
+
+// before init_serial, and with a full ring, wait for the fifo to drain
+static void tx_poll() {
+    while(!(inb(COM1 + LINE_STATUS) & STATUS_EMPTY))
+        ;
+
+    tx_fill();
+}
+
+void serial_write(const char* buffer, size_t size) {
+    uint32_t flags = irq_save();
+
+    for(size_t i = 0; i < size; i++) {
+        while(tx_head - tx_tail == TX_SIZE)
+            tx_poll();
+
+        tx_buffer[tx_head++ & (TX_SIZE - 1)] = buffer[i];
+    }
+
+    if(serial_ready)
+        tx_start();
+    else
+        while(tx_tail != tx_head)
+            tx_poll();
+
+    irq_restore(flags);
+}
+
+void serial_putc(char ch) {
+    serial_write(&ch, 1);
+}
+
+// 8 hex digits, most significant first
+void serial_hex(uint32_t value) {
+    static const char digits[] = "0123456789abcdef";
+    char buffer[8];
+
+    for(int i = 0; i < 8; i++)
+        buffer[i] = digits[(value >> (28 - i * 4)) & 0xf];
+
+    serial_write(buffer, sizeof(buffer));
+}
+
+// push out everything queued, for when interrupts won't come back
+void serial_sync() {
+    uint32_t flags = irq_save();
+
+    while(tx_tail != tx_head)
+        tx_poll();
+
+    irq_restore(flags);
+}
+
+// blocks until at least one byte arrives
+int serial_read(char* buffer, size_t size) {
+    uint32_t flags = irq_save();
+    size_t count = 0;
+
+    while(rx_head == rx_tail)
+        sleep_on(&rx_wait);
+
+    while(count < size && rx_tail != rx_head)
+        buffer[count++] = rx_buffer[rx_tail++ & (RX_SIZE - 1)];
+
+    irq_restore(flags);
+    return count;
+}
+
+static void serial_interrupt() {
+    uint8_t identify;
+
+    while(!((identify = inb(COM1 + IDENTIFY)) & IDENTIFY_NONE)) {
+        switch(identify & IDENTIFY_MASK) {
+        case IDENTIFY_TX:
+            if(tx_tail == tx_head) {
+                tx_running = 0;
+                outb(COM1 + INTERRUPT, INTERRUPT_RX);
+            } else {
+                tx_fill();
+            }
+            break;
+
+        case IDENTIFY_RX:
+        case IDENTIFY_TIMEOUT: {
+            int received = 0;
+
+            while(inb(COM1 + LINE_STATUS) & STATUS_READY) {
+                char ch = inb(COM1 + DATA);
+
+                // drop input nobody reads
+                if(rx_head - rx_tail < RX_SIZE)
+                    rx_buffer[rx_head++ & (RX_SIZE - 1)] = ch;
+
+                received = 1;
+            }
+
+            if(received)
+                wake_up(&rx_wait);
+            break;
+        }
+
+        default:
+            inb(COM1 + LINE_STATUS);
+            inb(COM1 + MODEM_STATUS);
+            break;
+        }
+    }
+}
+
+void init_serial() {
+    outb(COM1 + INTERRUPT, 0x00);
+
+    // 115200 baud
+    outb(COM1 + LINE_CONTROL, LINE_DLAB);
+    outb(COM1 + DIVISOR_LOW, 0x01);
+    outb(COM1 + DIVISOR_HIGH, 0x00);
+    outb(COM1 + LINE_CONTROL, LINE_8N1);
+
+    outb(COM1 + FIFO, FIFO_ENABLE | FIFO_CLEAR | FIFO_TRIGGER8);
+    outb(COM1 + MODEM_CONTROL, MODEM_DTR | MODEM_RTS | MODEM_OUT2);
+}
+
+// the uart goes interrupt driven once the pic and the handlers are set up
+void init_serial_interrupt() {
+    register_interrupt_handler(SERIAL_IRQ, &serial_interrupt);
+    enable_irq(SERIAL_IRQ);
+    outb(COM1 + INTERRUPT, INTERRUPT_RX);
+    serial_ready = 1;
+}
@@ -0,0 +1,12 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#define COM1 0x3f8
+
+void serial_putc(char ch);
+void serial_write(const char* buffer, size_t size);
+void serial_hex(uint32_t value);
+void serial_sync();
+int serial_read(char* buffer, size_t size);
+
+#endif //SERIAL_H
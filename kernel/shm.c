@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "file.h"
+#include "task.h"
+#include "paging.h"
+#include "heap.h"
+#include "global.h"
+
+#define SHM_MAX 32
+
+/*
+ * shared memory segments
+ *
+ * a segment is a set of frames found by a key. shm_create returns a file
+ * descriptor on it and the segment holds one reference on each frame for
+ * as long as some descriptor is open. Every mapping takes its own frame
+ * references, so mappings outlive the descriptors and the last one to go
+ * (unmap, exit or close) frees the memory.
+ */
+struct shm_t {
+    uint32_t key;
+    uint32_t pages;
+    uint32_t* frames;
+    int refs;
+};
+
+static struct shm_t* segments[SHM_MAX];
+
+static struct shm_t* shm_find(uint32_t key) {
+    for(int i = 0; i < SHM_MAX; i++) {
+        if(segments[i] && segments[i]->key == key)
+            return segments[i];
+    }
+
+    return 0;
+}
+
+static struct shm_t* shm_alloc(uint32_t key, uint32_t pages) {
+    int slot = 0;
+
+    while(slot < SHM_MAX && segments[slot])
+        slot++;
+
+    if(slot == SHM_MAX)
+        return 0;
+
+    struct shm_t* shm = (struct shm_t*)kmalloc(sizeof(struct shm_t));
+    shm->key = key;
+    shm->pages = pages;
+    shm->refs = 0;
+    shm->frames = (uint32_t*)kmalloc(pages * sizeof(uint32_t));
+
+    for(uint32_t i = 0; i < pages; i++) {
+        shm->frames[i] = alloc_frame();
+        clear_page((void*)shm->frames[i]);
+    }
+
+    segments[slot] = shm;
+    return shm;
+}
+
+static void shm_close(struct file_t* file) {
+    struct shm_t* shm = (struct shm_t*)file->data;
+
+    if(--shm->refs > 0)
+        return;
+
+    for(int i = 0; i < SHM_MAX; i++) {
+        if(segments[i] == shm)
+            segments[i] = 0;
+    }
+
+    for(uint32_t i = 0; i < shm->pages; i++)
+        put_frame(shm->frames[i]);
+
+    kfree(shm->frames);
+    kfree(shm);
+}
+
+static const struct file_ops_t shm_ops = {
+    .close = shm_close,
+};
+
+static int is_page_aligned(uint32_t value) {
+    return (value & (PAGE_SIZE - 1)) == 0;
+}
+
+// shm_create(key, size), opens the segment with that key or creates it
+void system_shm_create() {
+    struct trap_t* trap = current_task->trap;
+    uint32_t key = trap->ebx;
+    uint32_t pages = (trap->esi + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    struct shm_t* shm = shm_find(key);
+
+    if(!shm) {
+        if(!pages || !(shm = shm_alloc(key, pages))) {
+            trap->eax = -1;
+            return;
+        }
+    }
+
+    struct file_t* file = alloc_file(&shm_ops, shm, 0);
+    int fd = install_file(file);
+
+    shm->refs++;
+
+    if(fd < 0) {
+        file_put(file);
+        trap->eax = -1;
+        return;
+    }
+
+    trap->eax = fd;
+}
+
+// shm_map(fd, address), returns the size mapped
+void system_shm_map() {
+    struct trap_t* trap = current_task->trap;
+    int fd = trap->ebx;
+    uint32_t address = trap->esi;
+    struct pde_t* directory = current_directory;
+
+    struct file_t* file = (fd >= 0 && fd < TASK_FILES) ? current_task->files[fd] : 0;
+
+    if(!file || file->ops != &shm_ops || !is_page_aligned(address)) {
+        trap->eax = -1;
+        return;
+    }
+
+    struct shm_t* shm = (struct shm_t*)file->data;
+
+    for(uint32_t i = 0; i < shm->pages; i++) {
+        if(map_frame(directory, address + i * PAGE_SIZE, shm->frames[i], MAP_SHARED) != 0) {
+            while(i-- > 0)
+                unmap_frame(directory, address + i * PAGE_SIZE);
+
+            trap->eax = -1;
+            return;
+        }
+    }
+
+    trap->eax = shm->pages * PAGE_SIZE;
+}
+
+// shm_unmap(address, size)
+void system_shm_unmap() {
+    struct trap_t* trap = current_task->trap;
+    uint32_t address = trap->ebx;
+    uint32_t size = trap->esi;
+
+    if(!is_page_aligned(address)) {
+        trap->eax = -1;
+        return;
+    }
+
+    for(uint32_t offset = 0; offset < size; offset += PAGE_SIZE)
+        unmap_frame(current_directory, address + offset);
+
+    trap->eax = 0;
+}
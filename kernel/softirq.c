@@ -0,0 +1,45 @@
+#include <stdint.h>
+
+#include "softirq.h"
+#include "asm.h"
+
+static softirq_handler_t softirq_table[SOFTIRQ_MAX];
+static volatile uint32_t softirq_pending = 0;
+static int softirq_running = 0;
+
+void open_softirq(int softirq, softirq_handler_t handler) {
+    softirq_table[softirq] = handler;
+}
+
+// called from irq context, the work runs on the way out of handle_irq
+void raise_softirq(int softirq) {
+    softirq_pending |= 1 << softirq;
+}
+
+int in_softirq() {
+    return softirq_running;
+}
+
+// called with interrupts disabled, handlers run with them enabled
+void do_softirq() {
+    if(softirq_running || !softirq_pending)
+        return;
+
+    softirq_running = 1;
+
+    while(softirq_pending) {
+        uint32_t pending = softirq_pending;
+        softirq_pending = 0;
+
+        sti();
+
+        for(int i = 0; pending; i++, pending >>= 1) {
+            if((pending & 1) && softirq_table[i])
+                softirq_table[i]();
+        }
+
+        cli();
+    }
+
+    softirq_running = 0;
+}
@@ -0,0 +1,15 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#define SOFTIRQ_CONSOLE  0
+
+#define SOFTIRQ_MAX      32
+
+typedef void (*softirq_handler_t)();
+
+void open_softirq(int softirq, softirq_handler_t handler);
+void raise_softirq(int softirq);
+void do_softirq();
+int in_softirq();
+
+#endif //SOFTIRQ_H
@@ -0,0 +1,72 @@
+#include <stdint.h>
+
+#include "stack.h"
+#include "paging.h"
+#include "heap.h"
+#include "global.h"
+
+#define GUARD_SIZE     PAGE_SIZE
+#define STACK_POOL_MAX 16
+
+/*
+ * kernel stacks
+ *
+ * each stack is a page aligned block with its lowest page unmapped, running
+ * off the bottom faults (as a double fault, see descriptor.c) instead of
+ * trashing the heap. Released stacks go back to a small pool and are
+ * reused as they are, only the trap frame and context at the top are ever
+ * initialized. The pool is linked through the first word of each stack.
+ */
+
+struct free_stack_t {
+    struct free_stack_t* next;
+};
+
+static struct free_stack_t* stack_pool = 0;
+static int stack_pool_size = 0;
+
+// [start, end) of every guard page handed out, for the double fault report
+static uint32_t guard_low = ~0;
+static uint32_t guard_high = 0;
+
+void* alloc_kernel_stack() {
+    if(stack_pool) {
+        struct free_stack_t* stack = stack_pool;
+        stack_pool = stack->next;
+        stack_pool_size--;
+        return stack;
+    }
+
+    uint32_t block = (uint32_t)kamalloc(GUARD_SIZE + KERNEL_STACK_SIZE, PAGE_SIZE);
+    if(!block)
+        return 0;
+
+    unmap_page(kernel_directory, block);
+
+    if(block < guard_low) guard_low = block;
+    if(block + GUARD_SIZE > guard_high) guard_high = block + GUARD_SIZE;
+
+    return (void*)(block + GUARD_SIZE);
+}
+
+void free_kernel_stack(void* stack) {
+    if(!stack)
+        return;
+
+    if(stack_pool_size < STACK_POOL_MAX) {
+        struct free_stack_t* free_stack = (struct free_stack_t*)stack;
+        free_stack->next = stack_pool;
+        stack_pool = free_stack;
+        stack_pool_size++;
+        return;
+    }
+
+    uint32_t block = (uint32_t)stack - GUARD_SIZE;
+    remap(kernel_directory, block, block);
+    kfree((void*)block);
+}
+
+int is_stack_guard(uint32_t address) {
+    return address >= guard_low && address < guard_high &&
+        !is_page_present(kernel_directory, address);
+}
@@ -0,0 +1,11 @@
+#ifndef STACK_H
+#define STACK_H
+
+#define KERNEL_STACK_SIZE 8192
+
+void* alloc_kernel_stack();
+void free_kernel_stack(void* stack);
+
+int is_stack_guard(uint32_t address);
+
+#endif //STACK_H
@@ -1,16 +1,175 @@
 #include "string.h"
+#include "asm.h"
+
+#define PAGE_SIZE   4096
+
+#define CPUID_SSE2  (1 << 26)
+
+/*
+ * bulk of the work is done with dword rep-string instructions, the tail
+ * with byte ones. gcc can't see what rep movs/stos touch, so the asm
+ * operands carry the pointers and counters and clobber memory.
+ */
 
 void* memset(void* ptr, int byte, size_t size) {
-    char* p = (char*)ptr;
-    for(size_t i = 0; i < size; i++)
-        *p++ = byte;
+    uint32_t value = (uint8_t)byte * 0x01010101;
+    void* dst = ptr;
+    size_t dwords = size >> 2;
+    size_t bytes = size & 3;
+
+    __asm__ __volatile__ (
+        "rep stosl          \n"
+        "movl %3, %%ecx     \n"
+        "rep stosb          \n"
+        : "+D"(dst), "+c"(dwords)
+        : "a"(value), "r"(bytes)
+        : "memory"
+    );
+
     return ptr;
 }
 
 void* memcpy(void* dst, const void* src, size_t size) {
-    char* d = (char*)dst;
-    const char* s = (const char*)src;
-    for(size_t i = 0; i < size; i++)
-        *d++ = *s++;
+    void* d = dst;
+    const void* s = src;
+    size_t dwords = size >> 2;
+    size_t bytes = size & 3;
+
+    __asm__ __volatile__ (
+        "rep movsl          \n"
+        "movl %3, %%ecx     \n"
+        "rep movsb          \n"
+        : "+D"(d), "+S"(s), "+c"(dwords)
+        : "r"(bytes)
+        : "memory"
+    );
+
+    return dst;
+}
+
+void* memmove(void* dst, const void* src, size_t size) {
+    if((uint32_t)dst - (uint32_t)src >= size)
+        return memcpy(dst, src, size);
+
+    // overlapping with dst above src, copy backwards. Every trap, irq and
+    // sysenter entry runs cld, so an interrupt landing here is fine
+    void* d = (char*)dst + size - 1;
+    const void* s = (const char*)src + size - 1;
+    size_t count = size;
+
+    __asm__ __volatile__ (
+        "std                \n"
+        "rep movsb          \n"
+        "cld                \n"
+        : "+D"(d), "+S"(s), "+c"(count)
+        :
+        : "memory"
+    );
+
     return dst;
 }
+
+int memcmp(const void* ptr0, const void* ptr1, size_t size) {
+    const uint8_t* p0 = (const uint8_t*)ptr0;
+    const uint8_t* p1 = (const uint8_t*)ptr1;
+
+    // skip the equal prefix a dword at a time
+    while(size >= 4 && *(const uint32_t*)p0 == *(const uint32_t*)p1) {
+        p0 += 4;
+        p1 += 4;
+        size -= 4;
+    }
+
+    for(size_t i = 0; i < size; i++) {
+        if(p0[i] != p1[i])
+            return p0[i] - p1[i];
+    }
+
+    return 0;
+}
+
+size_t strlen(const char* str) {
+    const char* end = str;
+
+    while(*end)
+        end++;
+
+    return end - str;
+}
+
+int strcmp(const char* str0, const char* str1) {
+    while(*str0 && *str0 == *str1) {
+        str0++;
+        str1++;
+    }
+
+    return (uint8_t)*str0 - (uint8_t)*str1;
+}
+
+static void copy_page_rep(void* dst, const void* src) {
+    memcpy(dst, src, PAGE_SIZE);
+}
+
+static void clear_page_rep(void* page) {
+    memset(page, 0, PAGE_SIZE);
+}
+
+// sse2 movnti streams the stores past the caches, the page isn't read back
+// soon after a copy/clear so there is no point polluting them
+static void copy_page_nt(void* dst, const void* src) {
+    uint32_t count = PAGE_SIZE / 16;
+
+    __asm__ __volatile__ (
+        "1:                       \n"
+        "    prefetchnta 256(%1)  \n"
+        "    movl 0(%1), %%eax    \n"
+        "    movl 4(%1), %%edx    \n"
+        "    movnti %%eax, 0(%0)  \n"
+        "    movnti %%edx, 4(%0)  \n"
+        "    movl 8(%1), %%eax    \n"
+        "    movl 12(%1), %%edx   \n"
+        "    movnti %%eax, 8(%0)  \n"
+        "    movnti %%edx, 12(%0) \n"
+        "    addl $16, %1         \n"
+        "    addl $16, %0         \n"
+        "    decl %2              \n"
+        "    jnz 1b               \n"
+        "    sfence               \n"
+        : "+r"(dst), "+r"(src), "+r"(count)
+        :
+        : "eax", "edx", "memory"
+    );
+}
+
+static void clear_page_nt(void* page) {
+    uint32_t count = PAGE_SIZE / 16;
+
+    __asm__ __volatile__ (
+        "1:                       \n"
+        "    movnti %2, 0(%0)     \n"
+        "    movnti %2, 4(%0)     \n"
+        "    movnti %2, 8(%0)     \n"
+        "    movnti %2, 12(%0)    \n"
+        "    addl $16, %0         \n"
+        "    decl %1              \n"
+        "    jnz 1b               \n"
+        "    sfence               \n"
+        : "+r"(page), "+r"(count)
+        : "r"(0)
+        : "memory"
+    );
+}
+
+void (*copy_page)(void* dst, const void* src) = copy_page_rep;
+void (*clear_page)(void* page) = clear_page_rep;
+
+void init_string() {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    if(edx & CPUID_SSE2) {
+        copy_page = copy_page_nt;
+        clear_page = clear_page_nt;
+    }
+}
@@ -3,23 +3,136 @@
 #include "syscall.h"
 #include "task.h"
 #include "interrupt.h"
+#include "asm.h"
+#include "trace.h"
 #include "global.h"
+#include "kernel.h"
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+#define CPUID_SEP        (1 << 11)
+
+#define SYSENTER_STACK_SIZE 64
 
 void system_fork();
 void system_getpid();
+void system_ring_setup();
+void system_ring_enter();
+void system_exit();
+void system_waitpid();
+void system_clone();
+void system_futex();
+void system_send();
+void system_recv();
+void system_call_ipc();
+void system_reply();
+void system_pipe();
+void system_read();
+void system_write();
+void system_close();
+void system_shm_create();
+void system_shm_map();
+void system_shm_unmap();
+void system_trace();
+void system_profile();
+void system_open();
+void system_mmap();
+void system_exec();
 
 static void (*system_calls[])() = {
-    [SYSTEM_fork]   system_fork,
-    [SYSTEM_getpid] system_getpid,
+    [SYSTEM_fork]       system_fork,
+    [SYSTEM_getpid]     system_getpid,
+    [SYSTEM_ring_setup] system_ring_setup,
+    [SYSTEM_ring_enter] system_ring_enter,
+    [SYSTEM_exit]       system_exit,
+    [SYSTEM_waitpid]    system_waitpid,
+    [SYSTEM_clone]      system_clone,
+    [SYSTEM_futex]      system_futex,
+    [SYSTEM_send]       system_send,
+    [SYSTEM_recv]       system_recv,
+    [SYSTEM_call]       system_call_ipc,
+    [SYSTEM_reply]      system_reply,
+    [SYSTEM_pipe]       system_pipe,
+    [SYSTEM_read]       system_read,
+    [SYSTEM_write]      system_write,
+    [SYSTEM_close]      system_close,
+    [SYSTEM_shm_create] system_shm_create,
+    [SYSTEM_shm_map]    system_shm_map,
+    [SYSTEM_shm_unmap]  system_shm_unmap,
+    [SYSTEM_trace]      system_trace,
+    [SYSTEM_profile]    system_profile,
+    [SYSTEM_open]       system_open,
+    [SYSTEM_mmap]       system_mmap,
+    [SYSTEM_munmap]     system_shm_unmap, // unmapping doesn't care where pages came from
+    [SYSTEM_exec]       system_exec,
 };
 
-void system_call() {
-    int syscall_number = current_task->trap->eax;
+#define SYSTEM_CALLS (sizeof(system_calls) / sizeof(system_calls[0]))
+
+// scratch stack for the first instructions of sysenter_entry
+static uint8_t sysenter_stack[SYSENTER_STACK_SIZE] __attribute__((aligned(16)));
+
+static void dispatch_system_call(struct trap_t* trap) {
+    uint32_t syscall_number = trap->eax;
+
+    trace(TRACE_SYSCALL, syscall_number, trap->ebx, trap->esi, trap->edi);
+
+    if(syscall_number >= SYSTEM_CALLS || !system_calls[syscall_number]) {
+        trap->eax = -1;
+        return;
+    }
 
     system_calls[syscall_number]();
 }
 
+// run a system call on behalf of the current task outside of a trap,
+// with a scratch frame that carries the arguments and the result
+int do_system_call(uint32_t number, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    struct trap_t* saved = current_task->trap;
+    struct trap_t trap = *saved;
+
+    trap.eax = number;
+    trap.ebx = arg0;
+    trap.esi = arg1;
+    trap.edi = arg2;
+
+    current_task->trap = &trap;
+    dispatch_system_call(&trap);
+    current_task->trap = saved;
+
+    return trap.eax;
+}
+
+// int $0x80
+void system_call() {
+    dispatch_system_call(current_task->trap);
+}
+
+// sysenter, see trap.S
+void handle_sysenter(struct trap_t* trap) {
+    current_task->trap = trap;
+    dispatch_system_call(trap);
+}
+
+static void init_sysenter() {
+    extern void sysenter_entry();
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    if(!(edx & CPUID_SEP)) {
+        kprintf("sysenter is not supported by this cpu\n");
+        return;
+    }
+
+    wrmsr(MSR_SYSENTER_CS, 0x08, 0);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)sysenter_stack + SYSENTER_STACK_SIZE, 0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry, 0);
+}
+
 void init_system_call() {
     register_interrupt_handler(0x80, &system_call);
+    init_sysenter();
 }
-
@@ -1,8 +1,50 @@
 #ifndef SYSCALL_H
 #define SYSCALL_H
 
-#define SYSTEM_fork   0
-#define SYSTEM_getpid 1
+#define SYSTEM_fork       0
+#define SYSTEM_getpid     1
+#define SYSTEM_ring_setup 2
+#define SYSTEM_ring_enter 3
+#define SYSTEM_exit       4
+#define SYSTEM_waitpid    5
+#define SYSTEM_clone      6
+#define SYSTEM_futex      7
+#define SYSTEM_send       8
+#define SYSTEM_recv       9
+#define SYSTEM_call       10
+#define SYSTEM_reply      11
+#define SYSTEM_pipe       12
+#define SYSTEM_read       13
+#define SYSTEM_write      14
+#define SYSTEM_close      15
+#define SYSTEM_shm_create 16
+#define SYSTEM_shm_map    17
+#define SYSTEM_shm_unmap  18
+#define SYSTEM_trace      19
+#define SYSTEM_profile    20
+#define SYSTEM_open       21
+#define SYSTEM_mmap       22
+#define SYSTEM_munmap     23
+#define SYSTEM_exec       24
 
-#endif //SYSCALL_H
+/*
+ * fast system call through sysenter, the kernel returns to the label after
+ * it with the result in %eax. %ecx and %edx carry the stack and return
+ * address, so arguments go in %ebx, %esi and %edi (int $0x80 uses the same
+ * registers).
+ */
+static inline int syscall(int number, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    int ret;
+    __asm__ __volatile__ (
+        "    movl %%esp, %%ecx    \n"
+        "    leal 1f, %%edx       \n"
+        "    sysenter             \n"
+        "1:                       \n"
+        : "=a"(ret)
+        : "a"(number), "b"(arg0), "S"(arg1), "D"(arg2)
+        : "ecx", "edx", "memory"
+    );
+    return ret;
+}
 
+#endif //SYSCALL_H
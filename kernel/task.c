@@ -5,53 +5,366 @@
 #include "kernel.h"
 #include "asm.h"
 #include "interrupt.h"
+#include "softirq.h"
+#include "fpu.h"
+#include "stack.h"
+#include "ipc.h"
+#include "file.h"
+#include "trace.h"
+#include "profile.h"
 #include "paging.h"
 #include "heap.h"
+#include "exec.h"
+#include "ring.h"
 #include "global.h"
 
 struct task_t* current_task;
+static struct task_t* init_task = 0;
+struct task_t* task_list = 0;
 static struct task_t* ready_queue_start = 0;
 static struct task_t* ready_queue_end = 0;
 
 static int next_pid = 0;
 static uint32_t ticks = 0;
+static struct wait_queue_t timer_wait;
+static int idling = 0;
 
 extern void trap_end();
 
-void system_fork() {
-    struct pde_t* page_directory = current_directory;
-    
+// the running task is never in the ready queue
+static void enqueue_task(struct task_t* task) {
+    task->next = 0;
+
+    if(ready_queue_end)
+        ready_queue_end->next = task;
+    else
+        ready_queue_start = task;
+
+    ready_queue_end = task;
+}
+
+static struct task_t* dequeue_task() {
+    struct task_t* task = ready_queue_start;
+
+    if(task) {
+        ready_queue_start = task->next;
+        if(!ready_queue_start)
+            ready_queue_end = 0;
+        task->next = 0;
+    }
+
+    return task;
+}
+
+struct task_t* find_task(int pid) {
+    for(struct task_t* task = task_list; task; task = task->list_next) {
+        if(task->pid == pid)
+            return task;
+    }
+
+    return 0;
+}
+
+static struct task_t* create_task(struct pde_t* page_directory) {
     struct task_t* new_task = (struct task_t*)kmalloc(sizeof(struct task_t));
     memset(new_task, 0, sizeof(struct task_t));
 
     new_task->pid = next_pid++;
+    new_task->state = TASK_RUNNING;
+    new_task->parent = current_task;
     new_task->page_directory = page_directory;
-    new_task->stack = kmalloc(4096);
-    memset(new_task->stack, 0, 4096);
+    new_task->stack = alloc_kernel_stack();
+    new_task->esp0 = (uint32_t)new_task->stack + KERNEL_STACK_SIZE;
+
+    new_task->list_next = task_list;
+    task_list = new_task;
 
-    uint32_t esp = (uint32_t)new_task->stack + 4096;
+    return new_task;
+}
+
+// the new task resumes in trap_end with a copy of trap, built below top
+static void setup_trap(struct task_t* task, const struct trap_t* trap, uint32_t top) {
+    uint32_t esp = top;
 
     esp -= sizeof(struct trap_t);
-    new_task->trap = (struct trap_t*)esp;
+    task->trap = (struct trap_t*)esp;
 
     esp -= sizeof(struct context_t);
-    new_task->context = (struct context_t*)esp;
-    memset(new_task->context, 0, sizeof(struct context_t));
-    new_task->context->eip = (uint32_t) trap_end;
+    task->context = (struct context_t*)esp;
+    memset(task->context, 0, sizeof(struct context_t));
+    task->context->eip = (uint32_t) trap_end;
+
+    memcpy(task->trap, trap, sizeof(struct trap_t));
+}
+
+/*
+ * a ring 0 caller keeps running on its own stack after the same privilege
+ * iret, so the child gets a copy of the parent's stack from the trap frame
+ * up at the same distance from its own top. The saved frame pointers in
+ * the copy are moved along, pointers to stack variables held elsewhere
+ * still point into the parent's stack.
+ */
+static void copy_kernel_stack(struct task_t* task, struct trap_t* trap) {
+    uint32_t from = (uint32_t)trap;
+    uint32_t top = current_task->esp0;
+    uint32_t delta = task->esp0 - top;
+
+    setup_trap(task, trap, task->esp0 - (top - from) + sizeof(struct trap_t));
+    memcpy(task->trap, trap, top - from);
+
+    uint32_t ebp = task->trap->ebp;
+
+    if(ebp <= from || ebp >= top)
+        return;
 
-    memcpy(new_task->trap, current_task->trap, sizeof(struct trap_t));
+    task->trap->ebp += delta;
+
+    // the chain only goes up the stack
+    for(uint32_t* link = (uint32_t*)(ebp + delta); *link > ebp && *link < top; link = (uint32_t*)*link) {
+        ebp = *link;
+        *link += delta;
+    }
+}
+
+void system_fork() {
+    struct trap_t* trap = current_task->trap;
+    int user = trap->cs & 0x3;
+
+    // the part of a ring 0 stack that gets copied has to fit a kernel stack
+    if(!user && current_task->esp0 - (uint32_t)trap + sizeof(struct context_t) > KERNEL_STACK_SIZE) {
+        trap->eax = -1;
+        return;
+    }
+
+    struct pde_t* page_directory = clone_page_directory(current_directory);
+    struct task_t* new_task = create_task(page_directory);
+
+    if(user)
+        setup_trap(new_task, trap, new_task->esp0);
+    else
+        copy_kernel_stack(new_task, trap);
+
+    fpu_fork(new_task, current_task);
+    dup_files(new_task, current_task);
+    copy_vmas(new_task, current_task);
 
     new_task->trap->eax = 0;
-    current_task->trap->eax = new_task->pid;
+    trap->eax = new_task->pid;
 
-    ready_queue_end->next = new_task;
-    ready_queue_end = new_task;
+    enqueue_task(new_task);
+}
+
+/*
+ * clone(entry, stack, arg), a thread in the same address space
+ *
+ * it starts at entry on the given stack with arg as its only argument and
+ * must finish with exit, there is no return address. A ring 3 caller gets
+ * the frame on the thread kernel stack as usual. A same privilege iret
+ * doesn't load esp, so for a ring 0 caller the frame goes right below the
+ * new stack and iret leaves esp at the argument.
+ */
+void system_clone() {
+    struct trap_t* trap = current_task->trap;
+    uint32_t entry = trap->ebx;
+    uint32_t* stack = (uint32_t*)trap->esi;
+    uint32_t arg = trap->edi;
+
+    if(!entry || !stack) {
+        trap->eax = -1;
+        return;
+    }
+
+    // the argument and the return address go on the user stack
+    if((trap->cs & 0x3) && !user_writable((uint32_t)stack - 2 * sizeof(uint32_t), 2 * sizeof(uint32_t))) {
+        trap->eax = -1;
+        return;
+    }
+
+    struct task_t* new_task = create_task(current_task->page_directory);
+
+    if(trap->cs & 0x3) {
+        *--stack = arg;
+        *--stack = 0;
+
+        setup_trap(new_task, trap, new_task->esp0);
+        new_task->trap->user_esp = (uint32_t)stack;
+    } else {
+        // user_esp and ss are past the end of a ring 0 frame, they become
+        // the return address and the argument
+        setup_trap(new_task, trap, (uint32_t)stack);
+        new_task->trap->user_esp = 0;
+        new_task->trap->ss = arg;
+    }
+
+    dup_files(new_task, current_task);
+    copy_vmas(new_task, current_task);
+
+    new_task->trap->eip = entry;
+    new_task->trap->eax = 0;
+    trap->eax = new_task->pid;
+
+    enqueue_task(new_task);
+}
+
+__asm__ (
+".globl kthread_entry      \n"
+"kthread_entry:            \n"
+"    sti                   \n"
+"    pushl %esi            \n"  //arg
+"    call *%ebx            \n"  //fn
+"    pushl %eax            \n"
+"    call do_exit          \n"
+);
+
+void kthread_entry();
+
+/*
+ * kernel threads have no address space of their own, page_directory is 0
+ * and they run on whatever directory is loaded, so switching to one never
+ * reloads cr3.
+ */
+struct task_t* kthread_create(int (*fn)(void*), void* arg) {
+    uint32_t flags = irq_save();
+    struct task_t* new_task = create_task(0);
+
+    new_task->context = (struct context_t*)(new_task->esp0 - sizeof(struct context_t));
+    memset(new_task->context, 0, sizeof(struct context_t));
+    new_task->context->ebx = (uint32_t)fn;
+    new_task->context->esi = (uint32_t)arg;
+    new_task->context->eip = (uint32_t)kthread_entry;
+
+    enqueue_task(new_task);
+    irq_restore(flags);
+
+    return new_task;
 }
 
 void system_getpid() {
     current_task->trap->eax = current_task->pid;
 }
 
+static int directory_in_use(struct pde_t* directory, struct task_t* except) {
+    for(struct task_t* task = task_list; task; task = task->list_next) {
+        if(task != except && task->state != TASK_ZOMBIE && task->page_directory == directory)
+            return 1;
+    }
+
+    return 0;
+}
+
+// the old address space is freed when no other task uses it
+void set_task_directory(struct task_t* task, struct pde_t* directory) {
+    struct pde_t* old = task->page_directory;
+    task->page_directory = directory;
+
+    if(task == current_task && directory)
+        switch_page_directory(directory);
+
+    if(old && old != kernel_directory && !directory_in_use(old, task)) {
+        // one cr3 reload flushes the tlb for every page freed below
+        if(current_directory == old)
+            switch_page_directory(kernel_directory);
+
+        free_page_directory(old);
+    }
+}
+
+// give back everything but the task struct and the kernel stack we run on
+static void release_task(struct task_t* task) {
+    ring_release(task);
+
+    fpu_release(task);
+    close_files(task);
+    free_vmas(task);
+    set_task_directory(task, 0);
+}
+
+void do_exit(int code) {
+    struct task_t* task = current_task;
+
+    cli();
+
+    if(task == init_task) {
+        kprintf("init task exited with %d\n", code);
+        while(1)
+            hlt();
+    }
+
+    release_task(task);
+    ipc_exit(task);
+
+    // orphans are adopted by init, which reaps them
+    for(struct task_t* child = task_list; child; child = child->list_next) {
+        if(child->parent != task)
+            continue;
+
+        child->parent = init_task;
+        if(child->state == TASK_ZOMBIE)
+            wake_up(&init_task->wait_child);
+    }
+
+    task->exit_code = code;
+    task->state = TASK_ZOMBIE;
+    wake_up(&task->parent->wait_child);
+
+    schedule();
+}
+
+void system_exit() {
+    do_exit(current_task->trap->ebx);
+}
+
+static void reap_task(struct task_t* task) {
+    struct task_t** link = &task_list;
+
+    while(*link != task)
+        link = &(*link)->list_next;
+
+    *link = task->list_next;
+
+    free_kernel_stack(task->stack);
+    kfree(task);
+}
+
+// waitpid(pid or -1, int* status)
+void system_waitpid() {
+    struct trap_t* trap = current_task->trap;
+    int pid = trap->ebx;
+    int* status = (int*)trap->esi;
+
+    if(status && !user_writable(trap->esi, sizeof(int))) {
+        trap->eax = -1;
+        return;
+    }
+
+    while(1) {
+        int found = 0;
+
+        for(struct task_t* task = task_list; task; task = task->list_next) {
+            if(task->parent != current_task || (pid != -1 && task->pid != pid))
+                continue;
+
+            if(task->state == TASK_ZOMBIE) {
+                if(status)
+                    *status = task->exit_code;
+
+                trap->eax = task->pid;
+                reap_task(task);
+                return;
+            }
+
+            found = 1;
+        }
+
+        if(!found) {
+            trap->eax = -1;
+            return;
+        }
+
+        sleep_on(&current_task->wait_child);
+    }
+}
+
 __asm__ (
 ".globl switch_context     \n"
 "switch_context:           \n"
@@ -82,34 +395,163 @@ __asm__ (
 
 void switch_context(struct context_t** old, struct context_t* new);
 
+static void switch_task(struct task_t* old_task, struct task_t* new_task) {
+    current_task = new_task;
+
+    if(new_task == old_task)
+        return;
+
+    trace(TRACE_SCHEDULE, old_task->pid, new_task->pid, 0, 0);
+
+    if(new_task->page_directory && new_task->page_directory != current_directory)
+        switch_page_directory(new_task->page_directory);
+
+    fpu_switch(new_task);
+    set_kernel_stack(new_task->esp0);
+    switch_context(&old_task->context, new_task->context);
+}
+
 void schedule() {
     struct task_t* old_task = current_task;
+    struct task_t* new_task;
+
+    // a timer tick while waiting below
+    if(idling)
+        return;
 
-    current_task = current_task->next;
+    if(old_task->state == TASK_RUNNING)
+        enqueue_task(old_task);
 
-    if(!current_task)
-        current_task = ready_queue_start;
+    // nothing is runnable, wait on this stack for an irq to wake a task
+    while(!(new_task = dequeue_task())) {
+        idling = 1;
+        sti();
+        hlt();
+        cli();
+        idling = 0;
+    }
 
-    if(current_task != old_task)
-        switch_context(&old_task->context, current_task->context);
+    switch_task(old_task, new_task);
 }
 
-void timer_callback() {
-    ticks++;
+// run a blocked task right now, skipping the ready queue. The current task
+// goes to the back of the queue unless it blocked itself
+void handoff(struct task_t* task) {
+    struct task_t* old_task = current_task;
+
+    if(task->state != TASK_BLOCKED)
+        return;
+
+    task->state = TASK_RUNNING;
+
+    if(old_task->state == TASK_RUNNING)
+        enqueue_task(old_task);
+
+    switch_task(old_task, task);
+}
+
+void sleep_on(struct wait_queue_t* queue) {
+    uint32_t flags = irq_save();
+    struct task_t* task = current_task;
+
+    task->state = TASK_BLOCKED;
+    task->wait_next = 0;
+
+    if(queue->tail)
+        queue->tail->wait_next = task;
+    else
+        queue->head = task;
+
+    queue->tail = task;
+
     schedule();
+    irq_restore(flags);
+}
+
+void wake_task(struct task_t* task) {
+    if(task->state != TASK_BLOCKED)
+        return;
+
+    task->state = TASK_RUNNING;
+    enqueue_task(task);
+}
+
+// wake everybody, sleepers recheck their condition
+void wake_up(struct wait_queue_t* queue) {
+    uint32_t flags = irq_save();
+    struct task_t* task = queue->head;
+
+    queue->head = 0;
+    queue->tail = 0;
+
+    while(task) {
+        struct task_t* next = task->wait_next;
+        task->wait_next = 0;
+        wake_task(task);
+        task = next;
+    }
+
+    irq_restore(flags);
+}
+
+void lock(struct lock_t* lock) {
+    uint32_t flags = irq_save();
+
+    while(lock->locked)
+        sleep_on(&lock->wait);
+
+    lock->locked = 1;
+    irq_restore(flags);
+}
+
+void unlock(struct lock_t* lock) {
+    uint32_t flags = irq_save();
+
+    lock->locked = 0;
+    wake_up(&lock->wait);
+    irq_restore(flags);
+}
+
+// sleep for at least count timer ticks
+void sleep_ticks(uint32_t count) {
+    uint32_t flags = irq_save();
+    uint32_t deadline = ticks + count;
+
+    while((int32_t)(ticks - deadline) < 0)
+        sleep_on(&timer_wait);
+
+    irq_restore(flags);
+}
+
+void timer_callback(struct trap_t* trap) {
+    if(!profile_tick(trap))
+        return;
+
+    ticks++;
+
+    if(timer_wait.head)
+        wake_up(&timer_wait);
+
+    // softirqs run with interrupts enabled, don't switch away under them
+    if(!in_softirq())
+        schedule();
 }
 
 void init_tasking() {
     current_task = (struct task_t*)kmalloc(sizeof(struct task_t));
+    memset(current_task, 0, sizeof(struct task_t));
     current_task->pid = next_pid++;
+    current_task->state = TASK_RUNNING;
     current_task->page_directory = current_directory;
+    current_task->stack = (void*)__stack;
+    current_task->esp0 = (uint32_t)__stack + BOOT_STACK_SIZE;
     current_task->next = 0;
 
-    ready_queue_start = current_task;
-    ready_queue_end = current_task;
+    set_kernel_stack(current_task->esp0);
 
-    register_interrupt_handler(IRQ0, &timer_callback);
+    init_task = current_task;
+    task_list = current_task;
 
-    init_timer(19);
+    init_timer(TIMER_FREQUENCY);
 }
 
@@ -2,6 +2,9 @@
 #define TASK_H
 
 struct pde_t;
+struct syscall_ring_t;
+struct file_t;
+struct vma_t;
 
 struct context_t {
     uint32_t edi;
@@ -36,14 +39,67 @@ struct trap_t {
     uint32_t ss;
 } __attribute__((packed));
 
+#define TASK_RUNNING 0
+#define TASK_BLOCKED 1
+#define TASK_ZOMBIE  2
+
+#define TASK_FILES   16
+
+struct task_t;
+
+// tasks sleeping on something, linked through task_t.wait_next
+struct wait_queue_t {
+    struct task_t* head;
+    struct task_t* tail;
+};
+
+// a sleeping lock, zeroed is unlocked
+struct lock_t {
+    int locked;
+    struct wait_queue_t wait;
+};
+
 struct task_t {
     int pid;
+    int state;
+    int exit_code;
     struct trap_t* trap; 
     struct context_t* context;
     void* stack;
-    struct pde_t* page_directory;
-    struct task_t* next;
+    uint32_t esp0; // top of the kernel stack
+    struct pde_t* page_directory; // 0 for kernel threads
+    struct vma_t* vmas; // demand paged memory, see exec.c
+    struct syscall_ring_t* ring; // kernel view of the frame mapped at ring_address
+    uint32_t ring_address;
+    void* fpu_state; // fxsave area, allocated on first fpu use
+    struct file_t* files[TASK_FILES];
+    struct task_t* parent;
+    struct wait_queue_t wait_child; // waitpid sleeps here
+    struct task_t* wait_next;
+    uint32_t futex_key; // physical address of the futex word slept on
+    int ipc_state;
+    int ipc_partner; // pid sent to, received from or waiting a reply from
+    int ipc_call;
+    uint32_t ipc_message[2];
+    struct wait_queue_t ipc_senders; // tasks blocked sending to this one
+    struct task_t* list_next; // every task, zombies included
+    struct task_t* next; // ready queue
 };
 
+struct task_t* find_task(int pid);
+struct task_t* kthread_create(int (*fn)(void*), void* arg);
+
+void schedule();
+void sleep_on(struct wait_queue_t* queue);
+void wake_up(struct wait_queue_t* queue);
+void wake_task(struct task_t* task);
+void sleep_ticks(uint32_t count);
+void lock(struct lock_t* lock);
+void unlock(struct lock_t* lock);
+void handoff(struct task_t* task);
+
+void do_exit(int code);
+void set_task_directory(struct task_t* task, struct pde_t* directory);
+
 #endif //TASK_H
 
@@ -0,0 +1,256 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "tmpfs.h"
+#include "paging.h"
+#include "heap.h"
+#include "kernel.h"
+
+/*
+ * filesystem in memory
+ *
+ * the initrd is a tar archive loaded by the boot loader. Unpacking it
+ * only builds the tree, file contents stay in the archive and are read
+ * from there into the page cache.
+ */
+
+static const struct inode_ops_t tmpfs_inode_ops;
+
+static struct tmpfs_node_t* tmpfs_node(struct tmpfs_node_t* dir, const char* name, size_t length, int type) {
+    struct tmpfs_node_t* node = (struct tmpfs_node_t*)kmalloc(sizeof(struct tmpfs_node_t));
+
+    if(!node)
+        return 0;
+
+    memset(node, 0, sizeof(struct tmpfs_node_t));
+    memcpy(node->name, name, length);
+
+    if(!(node->inode = alloc_inode(&tmpfs_inode_ops, node, type, 0))) {
+        kfree(node);
+        return 0;
+    }
+
+    if(dir) {
+        node->next = dir->children;
+        dir->children = node;
+    }
+
+    return node;
+}
+
+static struct tmpfs_node_t* tmpfs_find(struct tmpfs_node_t* dir, const char* name, size_t length) {
+    struct tmpfs_node_t* node = dir->children;
+
+    while(node && (memcmp(node->name, name, length) != 0 || node->name[length]))
+        node = node->next;
+
+    return node;
+}
+
+static int tmpfs_lookup(struct inode_t* dir, const char* name, size_t length, struct inode_t** inode) {
+    struct tmpfs_node_t* node;
+
+    if(length >= DENTRY_NAME || !(node = tmpfs_find((struct tmpfs_node_t*)dir->data, name, length)))
+        return -1;
+
+    *inode = node->inode;
+    return 0;
+}
+
+static int tmpfs_create(struct inode_t* dir, const char* name, size_t length, struct inode_t** inode) {
+    struct tmpfs_node_t* node;
+
+    if(length >= DENTRY_NAME || !(node = tmpfs_node((struct tmpfs_node_t*)dir->data, name, length, VFS_FILE)))
+        return -1;
+
+    *inode = node->inode;
+    return 0;
+}
+
+static int tmpfs_readpage(struct inode_t* inode, uint32_t index, void* page) {
+    struct tmpfs_node_t* node = (struct tmpfs_node_t*)inode->data;
+    uint32_t offset = index * PAGE_SIZE;
+    uint32_t count = 0;
+
+    if(offset < inode->size)
+        count = inode->size - offset < PAGE_SIZE ? inode->size - offset : PAGE_SIZE;
+
+    memcpy(page, node->data + offset, count);
+    memset((uint8_t*)page + count, 0, PAGE_SIZE - count);
+    return 0;
+}
+
+// the first write copies a file out of the archive, files grow a page at a time
+static int tmpfs_write(struct inode_t* inode, uint32_t offset, const void* buffer, size_t size) {
+    struct tmpfs_node_t* node = (struct tmpfs_node_t*)inode->data;
+
+    // size comes from the caller, end and the rounded capacity must not wrap
+    if(offset > ~0u - PAGE_SIZE || size > ~0u - PAGE_SIZE - offset)
+        return -1;
+
+    uint32_t end = offset + size;
+
+    if(end > node->capacity) {
+        uint32_t capacity = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uint8_t* data = (uint8_t*)kmalloc(capacity);
+
+        if(!data)
+            return -1;
+
+        memcpy(data, node->data, inode->size);
+
+        if(node->capacity)
+            kfree(node->data);
+
+        node->data = data;
+        node->capacity = capacity;
+    }
+
+    if(offset > inode->size)
+        memset(node->data + inode->size, 0, offset - inode->size);
+
+    memcpy(node->data + offset, buffer, size);
+
+    if(end > inode->size)
+        inode->size = end;
+
+    return size;
+}
+
+static int tmpfs_truncate(struct inode_t* inode) {
+    inode->size = 0;
+    return 0;
+}
+
+static const struct inode_ops_t tmpfs_inode_ops = {
+    .lookup = tmpfs_lookup,
+    .create = tmpfs_create,
+    .readpage = tmpfs_readpage,
+    .write = tmpfs_write,
+    .truncate = tmpfs_truncate,
+};
+
+struct inode_t* tmpfs_root() {
+    struct tmpfs_node_t* root = tmpfs_node(0, "", 0, VFS_DIRECTORY);
+    return root ? root->inode : 0;
+}
+
+static uint32_t octal(const uint8_t* field, size_t length) {
+    uint32_t value = 0;
+
+    for(size_t i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++)
+        value = value * 8 + field[i] - '0';
+
+    return value;
+}
+
+// prefix/name of a header, neither field has to be terminated
+static void tar_path(const uint8_t* header, char* path) {
+    size_t length = 0;
+
+    for(size_t i = 0; i < TAR_PREFIX_SIZE && header[TAR_PREFIX + i]; i++)
+        path[length++] = header[TAR_PREFIX + i];
+
+    if(length)
+        path[length++] = '/';
+
+    for(size_t i = 0; i < TAR_NAME_SIZE && header[TAR_NAME + i]; i++)
+        path[length++] = header[TAR_NAME + i];
+
+    path[length] = 0;
+}
+
+// add path under dir, making the directories on the way
+static int tar_add(struct tmpfs_node_t* dir, const char* path, int type, const uint8_t* data, uint32_t size) {
+    while(1) {
+        while(*path == '/')
+            path++;
+
+        const char* end = path;
+        while(*end && *end != '/')
+            end++;
+
+        const char* next = end;
+        while(*next == '/')
+            next++;
+
+        size_t length = end - path;
+
+        // "./" is the root itself
+        if(!length)
+            return 0;
+
+        if(length == 1 && path[0] == '.') {
+            path = end;
+            continue;
+        }
+
+        if(length >= DENTRY_NAME)
+            return -1;
+
+        int last = !*next;
+        struct tmpfs_node_t* node = tmpfs_find(dir, path, length);
+
+        if(!node && !(node = tmpfs_node(dir, path, length, last ? type : VFS_DIRECTORY)))
+            return -1;
+
+        if(node->inode->type != (last ? type : VFS_DIRECTORY))
+            return -1;
+
+        if(last) {
+            if(type == VFS_FILE) {
+                node->data = (uint8_t*)data;
+                node->capacity = 0;
+                node->inode->size = size;
+            }
+
+            return 0;
+        }
+
+        dir = node;
+        path = next;
+    }
+}
+
+int tmpfs_unpack(struct inode_t* root, const void* archive, uint32_t size) {
+    const uint8_t* header = (const uint8_t*)archive;
+    const uint8_t* end = header + size;
+    char path[TAR_PREFIX_SIZE + TAR_NAME_SIZE + 2];
+
+    // the archive ends with zero blocks
+    while(header + TAR_BLOCK <= end && header[0]) {
+        const uint8_t* data = header + TAR_BLOCK;
+        uint32_t length = octal(header + TAR_SIZE, 12);
+        uint8_t type = header[TAR_TYPE];
+
+        if(memcmp(header + TAR_MAGIC, "ustar", 5) != 0 || length > (uint32_t)(end - data))
+            return -1;
+
+        tar_path(header, path);
+
+        if(type == TAR_FILE || type == 0 || type == TAR_DIRECTORY) {
+            if(tar_add((struct tmpfs_node_t*)root->data, path, type == TAR_DIRECTORY ? VFS_DIRECTORY : VFS_FILE,
+                       data, length) < 0)
+                return -1;
+        }
+
+        header = data + ((length + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1));
+    }
+
+    return 0;
+}
+
+void init_initrd(uint32_t start, uint32_t size) {
+    struct inode_t* root;
+
+    if(!size)
+        return;
+
+    if(!(root = tmpfs_root()) || tmpfs_unpack(root, (const void*)start, size) < 0) {
+        kprintf("initrd: not a tar archive\n");
+        return;
+    }
+
+    vfs_mount("/", root);
+    kprintf("initrd: %d bytes at %x\n", size, start);
+}
@@ -0,0 +1,35 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "vfs.h"
+
+// ustar header fields
+#define TAR_BLOCK       512
+#define TAR_NAME        0
+#define TAR_NAME_SIZE   100
+#define TAR_SIZE        124
+#define TAR_TYPE        156
+#define TAR_MAGIC       257
+#define TAR_PREFIX      345
+#define TAR_PREFIX_SIZE 155
+
+#define TAR_FILE        '0'
+#define TAR_DIRECTORY   '5'
+
+/*
+ * a file or directory kept in memory. Files unpacked from an archive
+ * point into it (capacity 0) until they are first written.
+ */
+struct tmpfs_node_t {
+    char name[DENTRY_NAME];
+    struct inode_t* inode;
+    uint8_t* data;
+    uint32_t capacity;
+    struct tmpfs_node_t* children;
+    struct tmpfs_node_t* next;
+};
+
+struct inode_t* tmpfs_root();
+int tmpfs_unpack(struct inode_t* root, const void* archive, uint32_t size);
+
+#endif //TMPFS_H
@@ -0,0 +1,120 @@
+#include <stdint.h>
+
+#include "trace.h"
+#include "serial.h"
+#include "task.h"
+#include "asm.h"
+#include "global.h"
+#include "kernel.h"
+
+/*
+ * per cpu ring of fixed size records
+ *
+ * a writer reserves a slot with an atomic increment of head and fills it in
+ * place, so an interrupt that traces in the middle of another record gets
+ * its own slot and nobody takes a lock. The ring overwrites the oldest
+ * records, head only grows and the slot is head modulo TRACE_RECORDS.
+ */
+struct trace_buffer_t {
+    volatile uint32_t head;
+    struct trace_record_t records[TRACE_RECORDS];
+} __attribute__((aligned(64)));
+
+static struct trace_buffer_t trace_buffers[NR_CPUS];
+
+volatile int trace_enabled;
+
+static inline int cpu_id() {
+    return 0;
+}
+
+void trace_event(uint16_t event, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    int cpu = cpu_id();
+    struct trace_buffer_t* buffer = &trace_buffers[cpu];
+
+    uint32_t slot = __sync_fetch_and_add(&buffer->head, 1);
+    struct trace_record_t* record = &buffer->records[slot & (TRACE_RECORDS - 1)];
+
+    record->tsc = rdtsc();
+    record->event = event;
+    record->cpu = cpu;
+    record->pid = current_task ? current_task->pid : 0;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    record->args[3] = arg3;
+}
+
+// a record per line, handed to the serial driver in one piece
+static void dump_record(const struct trace_record_t* record) {
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t* data = (const uint8_t*)record;
+    char line[sizeof(struct trace_record_t) * 2 + 1];
+
+    for(size_t i = 0; i < sizeof(struct trace_record_t); i++) {
+        line[i * 2 + 0] = digits[data[i] >> 4];
+        line[i * 2 + 1] = digits[data[i] & 0xf];
+    }
+
+    line[sizeof(line) - 1] = '\n';
+    serial_write(line, sizeof(line));
+}
+
+/*
+ * one "trace <cpu> <count>" line per cpu followed by a line of hex per
+ * record (the bytes as in memory), oldest first. tools/tracedump.py
+ * decodes it from a serial log.
+ */
+static void trace_dump() {
+    for(int cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct trace_buffer_t* buffer = &trace_buffers[cpu];
+        uint32_t head = buffer->head;
+        uint32_t first = head > TRACE_RECORDS ? head - TRACE_RECORDS : 0;
+        uint32_t count = head - first;
+
+        serial_write("trace ", 6);
+        serial_hex(cpu);
+        serial_putc(' ');
+        serial_hex(count);
+        serial_putc('\n');
+
+        for(uint32_t i = first; i != head; i++)
+            dump_record(&buffer->records[i & (TRACE_RECORDS - 1)]);
+    }
+
+    serial_write("end\n", 4);
+}
+
+void system_trace() {
+    struct trap_t* trap = current_task->trap;
+
+    switch(trap->ebx) {
+    case TRACE_START:
+        trace_enabled = 1;
+        break;
+
+    case TRACE_STOP:
+        trace_enabled = 0;
+        break;
+
+    case TRACE_DUMP: {
+        // writers would overwrite the records while they are printed
+        int enabled = trace_enabled;
+        trace_enabled = 0;
+        trace_dump();
+        trace_enabled = enabled;
+        break;
+    }
+
+    default:
+        trap->eax = -1;
+        return;
+    }
+
+    trap->eax = 0;
+}
+
+// off until a task asks for it with TRACE_START
+void init_trace() {
+    trace_enabled = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "syscall.h"
+
+#define NR_CPUS 1
+
+// event ids, keep in sync with tools/tracedump.py
+#define TRACE_SCHEDULE   1 // old pid, new pid
+#define TRACE_INTERRUPT  2 // vector, error code, eip
+#define TRACE_IRQ        3 // vector, eip
+#define TRACE_SYSCALL    4 // number, ebx, esi, edi
+#define TRACE_HEAP_ALLOC 5 // size, align, address
+#define TRACE_PAGE_FAULT 6 // address, error code, eip
+
+// system call commands
+#define TRACE_START 0
+#define TRACE_STOP  1
+#define TRACE_DUMP  2
+
+// records per cpu, must be a power of two
+#define TRACE_RECORDS 2048
+
+struct trace_record_t {
+    uint64_t tsc;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t pid;
+    uint32_t args[4];
+} __attribute__((packed));
+
+extern volatile int trace_enabled;
+
+void trace_event(uint16_t event, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+// a disabled tracepoint costs a load and a branch
+#define trace(event, arg0, arg1, arg2, arg3) \
+    do { \
+        if(trace_enabled) \
+            trace_event(event, (uint32_t)(arg0), (uint32_t)(arg1), (uint32_t)(arg2), (uint32_t)(arg3)); \
+    } while(0)
+
+static inline int trace_control(int command) {
+    return syscall(SYSTEM_trace, command, 0, 0);
+}
+
+#endif //TRACE_H
@@ -0,0 +1,477 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "vfs.h"
+#include "file.h"
+#include "paging.h"
+#include "heap.h"
+#include "task.h"
+#include "asm.h"
+#include "global.h"
+
+/*
+ * virtual filesystem
+ *
+ * paths are resolved through a cache of dentries hashed by (parent, name),
+ * a filesystem is only asked about names it hasn't been asked before.
+ * Dentries and their inodes stay cached.
+ *
+ * file data is read through a page cache, a frame per page of a file
+ * hashed by (inode, index). read() copies out of those frames and mmap()
+ * maps the same frames, so every reader of a file shares one copy. Pages
+ * nobody maps are recycled least recently used first once there are
+ * PAGE_CACHE_MAX of them. Writes go through to the filesystem and update
+ * the cached pages.
+ */
+
+static struct dentry_t* dentry_hash[DENTRY_HASH];
+static struct dentry_t root_dentry;
+
+static struct page_t* page_hash[PAGE_HASH];
+static struct page_t* lru_head;
+static struct page_t* lru_tail;
+static int page_count;
+
+struct inode_t* alloc_inode(const struct inode_ops_t* ops, void* data, int type, uint32_t size) {
+    struct inode_t* inode = (struct inode_t*)kmalloc(sizeof(struct inode_t));
+
+    if(inode) {
+        inode->ops = ops;
+        inode->data = data;
+        inode->type = type;
+        inode->size = size;
+        inode->pages = 0;
+        inode->version = 0;
+    }
+
+    return inode;
+}
+
+static uint32_t name_hash(struct dentry_t* parent, const char* name, size_t length) {
+    uint32_t hash = (uint32_t)parent >> 4;
+
+    for(size_t i = 0; i < length; i++)
+        hash = hash * 31 + name[i];
+
+    return hash % DENTRY_HASH;
+}
+
+static struct dentry_t* dentry_find(struct dentry_t* parent, const char* name, size_t length) {
+    struct dentry_t* dentry = dentry_hash[name_hash(parent, name, length)];
+
+    for(; dentry; dentry = dentry->hash_next) {
+        if(dentry->parent == parent && memcmp(dentry->name, name, length) == 0 && !dentry->name[length])
+            return dentry;
+    }
+
+    return 0;
+}
+
+static struct dentry_t* dentry_add(struct dentry_t* parent, const char* name, size_t length,
+                                   struct inode_t* inode) {
+    struct dentry_t* dentry = (struct dentry_t*)kmalloc(sizeof(struct dentry_t));
+
+    if(!dentry)
+        return 0;
+
+    memcpy(dentry->name, name, length);
+    dentry->name[length] = 0;
+    dentry->parent = parent;
+    dentry->inode = inode;
+
+    uint32_t hash = name_hash(parent, name, length);
+    dentry->hash_next = dentry_hash[hash];
+    dentry_hash[hash] = dentry;
+
+    return dentry;
+}
+
+// "." or ".."
+static int is_dots(const char* name, size_t length) {
+    return name[0] == '.' && (length == 1 || (length == 2 && name[1] == '.'));
+}
+
+/*
+ * resolve path from the root up to stop. With create set a missing last
+ * component is created as a file.
+ */
+static struct dentry_t* walk(const char* path, const char* stop, int create) {
+    struct dentry_t* dentry = &root_dentry;
+
+    if(!dentry->inode)
+        return 0;
+
+    while(path < stop && *path) {
+        while(path < stop && *path == '/')
+            path++;
+
+        const char* end = path;
+        while(end < stop && *end && *end != '/')
+            end++;
+
+        size_t length = end - path;
+        if(!length)
+            break;
+
+        if(length >= DENTRY_NAME || dentry->inode->type != VFS_DIRECTORY)
+            return 0;
+
+        // resolved here so the filesystem never sees them, ".." of the root is the root
+        if(is_dots(path, length)) {
+            if(length == 2 && dentry->parent)
+                dentry = dentry->parent;
+
+            path = end;
+            continue;
+        }
+
+        struct dentry_t* child = dentry_find(dentry, path, length);
+
+        if(!child) {
+            struct inode_t* dir = dentry->inode;
+            struct inode_t* inode = 0;
+
+            if(dir->ops->lookup(dir, path, length, &inode) < 0) {
+                if(!create || (end < stop && *end) || !dir->ops->create || dir->ops->create(dir, path, length, &inode) < 0)
+                    return 0;
+            }
+
+            // the lookup may have slept, another task may have added it
+            if(!(child = dentry_find(dentry, path, length)) &&
+               !(child = dentry_add(dentry, path, length, inode)))
+                return 0;
+        }
+
+        dentry = child;
+        path = end;
+    }
+
+    return dentry;
+}
+
+struct inode_t* vfs_lookup(const char* path) {
+    struct dentry_t* dentry = walk(path, path + strlen(path), 0);
+    return dentry ? dentry->inode : 0;
+}
+
+/*
+ * attach the root of a filesystem at path, "/" for the root. The mount
+ * point is a cached dentry and lookups find it before asking the
+ * directory, it doesn't have to exist underneath.
+ */
+int vfs_mount(const char* path, struct inode_t* root) {
+    const char* name = path;
+
+    for(const char* c = path; *c; c++) {
+        if(*c == '/')
+            name = c + 1;
+    }
+
+    size_t length = strlen(name);
+
+    if(!length) {
+        root_dentry.inode = root;
+        return 0;
+    }
+
+    struct dentry_t* parent = walk(path, name, 0);
+
+    if(!parent || parent->inode->type != VFS_DIRECTORY || length >= DENTRY_NAME || is_dots(name, length))
+        return -1;
+
+    struct dentry_t* dentry = dentry_find(parent, name, length);
+
+    if(dentry) {
+        dentry->inode = root;
+        return 0;
+    }
+
+    return dentry_add(parent, name, length, root) ? 0 : -1;
+}
+
+static inline uint32_t page_hash_index(struct inode_t* inode, uint32_t index) {
+    return (((uint32_t)inode >> 4) + index) % PAGE_HASH;
+}
+
+static struct page_t* page_find(struct inode_t* inode, uint32_t index) {
+    struct page_t* page = page_hash[page_hash_index(inode, index)];
+
+    while(page && (page->inode != inode || page->index != index))
+        page = page->hash_next;
+
+    return page;
+}
+
+static void lru_remove(struct page_t* page) {
+    if(page->lru_prev)
+        page->lru_prev->lru_next = page->lru_next;
+    else
+        lru_head = page->lru_next;
+
+    if(page->lru_next)
+        page->lru_next->lru_prev = page->lru_prev;
+    else
+        lru_tail = page->lru_prev;
+}
+
+static void lru_push(struct page_t* page) {
+    page->lru_prev = 0;
+    page->lru_next = lru_head;
+
+    if(lru_head)
+        lru_head->lru_prev = page;
+    else
+        lru_tail = page;
+
+    lru_head = page;
+}
+
+static void page_insert(struct page_t* page) {
+    uint32_t hash = page_hash_index(page->inode, page->index);
+
+    page->hash_next = page_hash[hash];
+    page_hash[hash] = page;
+
+    page->inode_next = page->inode->pages;
+    page->inode->pages = page;
+
+    lru_push(page);
+    page_count++;
+}
+
+static void page_remove(struct page_t* page) {
+    struct page_t** link = &page_hash[page_hash_index(page->inode, page->index)];
+    while(*link != page)
+        link = &(*link)->hash_next;
+    *link = page->hash_next;
+
+    link = &page->inode->pages;
+    while(*link != page)
+        link = &(*link)->inode_next;
+    *link = page->inode_next;
+
+    lru_remove(page);
+    page_count--;
+
+    // a mapping may still hold the frame
+    put_frame(page->frame);
+    kfree(page);
+}
+
+static void shrink_page_cache() {
+    struct page_t* page = lru_tail;
+
+    while(page && page_count > PAGE_CACHE_MAX) {
+        struct page_t* prev = page->lru_prev;
+
+        if(frame_refcount(page->frame) == 1)
+            page_remove(page);
+
+        page = prev;
+    }
+}
+
+// the frame caching a page of the file, read in on a miss. The caller
+// gets a reference so the page can't be recycled under it, see put_frame
+uint32_t vfs_get_page(struct inode_t* inode, uint32_t index) {
+    uint32_t flags = irq_save();
+    struct page_t* page = page_find(inode, index);
+
+    if(page) {
+        lru_remove(page);
+        lru_push(page);
+        get_frame(page->frame);
+        irq_restore(flags);
+        return page->frame;
+    }
+
+    irq_restore(flags);
+
+    uint32_t frame = alloc_frame();
+    if(!frame)
+        return 0;
+
+    // a write patching the cache meanwhile would miss this page, read it again
+    while(1) {
+        uint32_t version = inode->version;
+
+        if(inode->ops->readpage(inode, index, (void*)frame) < 0) {
+            put_frame(frame);
+            return 0;
+        }
+
+        flags = irq_save();
+
+        if(inode->version == version)
+            break;
+
+        irq_restore(flags);
+    }
+
+    // somebody read the same page while this task slept
+    if((page = page_find(inode, index))) {
+        get_frame(page->frame);
+        irq_restore(flags);
+        put_frame(frame);
+        return page->frame;
+    }
+
+    if(!(page = (struct page_t*)kmalloc(sizeof(struct page_t)))) {
+        irq_restore(flags);
+        put_frame(frame);
+        return 0;
+    }
+
+    page->inode = inode;
+    page->index = index;
+    page->frame = frame;
+    page_insert(page);
+
+    // take the caller's reference first so the shrink can't free the new page
+    get_frame(frame);
+    shrink_page_cache();
+    irq_restore(flags);
+    return frame;
+}
+
+static void drop_pages(struct inode_t* inode) {
+    uint32_t flags = irq_save();
+
+    while(inode->pages)
+        page_remove(inode->pages);
+
+    inode->version++;
+
+    irq_restore(flags);
+}
+
+static int vfs_file_read(struct file_t* file, void* buffer, size_t size) {
+    struct inode_t* inode = (struct inode_t*)file->data;
+    size_t done = 0;
+
+    if(inode->type != VFS_FILE || file->offset >= inode->size)
+        return 0;
+
+    if(size > inode->size - file->offset)
+        size = inode->size - file->offset;
+
+    while(done < size) {
+        uint32_t offset = file->offset % PAGE_SIZE;
+        uint32_t count = PAGE_SIZE - offset;
+        uint32_t frame = vfs_get_page(inode, file->offset / PAGE_SIZE);
+
+        if(!frame)
+            return done ? (int)done : -1;
+
+        if(count > size - done)
+            count = size - done;
+
+        memcpy((uint8_t*)buffer + done, (uint8_t*)frame + offset, count);
+        put_frame(frame);
+        done += count;
+        file->offset += count;
+    }
+
+    return done;
+}
+
+static int vfs_file_write(struct file_t* file, const void* buffer, size_t size) {
+    struct inode_t* inode = (struct inode_t*)file->data;
+    uint32_t start = file->offset;
+
+    if(inode->type != VFS_FILE || !inode->ops->write)
+        return -1;
+
+    int written = inode->ops->write(inode, start, buffer, size);
+    if(written <= 0)
+        return written;
+
+    // keep cached pages in step with the disk
+    uint32_t flags = irq_save();
+
+    for(struct page_t* page = inode->pages; page; page = page->inode_next) {
+        uint32_t page_start = page->index * PAGE_SIZE;
+        uint32_t from = start > page_start ? start : page_start;
+        uint32_t to = start + written < page_start + PAGE_SIZE ? start + written : page_start + PAGE_SIZE;
+
+        if(from < to)
+            memcpy((uint8_t*)page->frame + (from - page_start), (const uint8_t*)buffer + (from - start), to - from);
+    }
+
+    inode->version++;
+
+    irq_restore(flags);
+
+    file->offset += written;
+    return written;
+}
+
+static const struct file_ops_t vfs_file_ops = {
+    .read = vfs_file_read,
+    .write = vfs_file_write,
+};
+
+struct file_t* vfs_open(const char* path, int flags) {
+    int writing = (flags & O_ACCMODE) != O_RDONLY;
+    struct dentry_t* dentry = walk(path, path + strlen(path), flags & O_CREAT);
+
+    if(!dentry)
+        return 0;
+
+    struct inode_t* inode = dentry->inode;
+
+    if(writing && inode->type == VFS_DIRECTORY)
+        return 0;
+
+    if(writing && (flags & O_TRUNC) && inode->ops->truncate) {
+        inode->ops->truncate(inode);
+        drop_pages(inode);
+    }
+
+    return alloc_file(&vfs_file_ops, inode, open_mode(flags));
+}
+
+struct inode_t* file_inode(struct file_t* file) {
+    return file->ops == &vfs_file_ops ? (struct inode_t*)file->data : 0;
+}
+
+// mmap(fd, address, size), maps the file from its start, shared and only
+// writable through an fd opened for writing
+void system_mmap() {
+    struct trap_t* trap = current_task->trap;
+    struct file_t* file = 0;
+    uint32_t address = trap->esi;
+    uint32_t size = trap->edi;
+
+    if(trap->ebx < TASK_FILES)
+        file = current_task->files[trap->ebx];
+
+    struct inode_t* inode = file ? file_inode(file) : 0;
+    int map = file && (file->flags & FILE_WRITE) ? MAP_SHARED : MAP_SHARED | MAP_READONLY;
+
+    if(!inode || inode->type != VFS_FILE || (address & (PAGE_SIZE - 1)) || !size ||
+       size > ((inode->size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))) {
+        trap->eax = -1;
+        return;
+    }
+
+    for(uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint32_t frame = vfs_get_page(inode, offset / PAGE_SIZE);
+        int mapped = frame && map_frame(current_directory, address + offset, frame, map) == 0;
+
+        if(frame)
+            put_frame(frame);
+
+        if(!mapped) {
+            while(offset > 0) {
+                offset -= PAGE_SIZE;
+                unmap_frame(current_directory, address + offset);
+            }
+
+            trap->eax = -1;
+            return;
+        }
+    }
+
+    trap->eax = address;
+}
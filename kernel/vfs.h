@@ -0,0 +1,60 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+
+#define VFS_FILE       0
+#define VFS_DIRECTORY  1
+
+#define DENTRY_NAME    32
+#define DENTRY_HASH    64
+#define PAGE_HASH      256
+#define PAGE_CACHE_MAX 1024 // pages
+
+struct inode_t;
+
+// filesystem side of an inode, lengths because names come out of paths
+struct inode_ops_t {
+    int (*lookup)(struct inode_t* dir, const char* name, size_t length, struct inode_t** inode);
+    int (*create)(struct inode_t* dir, const char* name, size_t length, struct inode_t** inode);
+    int (*readpage)(struct inode_t* inode, uint32_t index, void* page);
+    int (*write)(struct inode_t* inode, uint32_t offset, const void* buffer, size_t size);
+    int (*truncate)(struct inode_t* inode);
+};
+
+// a cached page of a file, index is the offset in pages
+struct page_t {
+    struct inode_t* inode;
+    uint32_t index;
+    uint32_t frame;
+    struct page_t* hash_next;
+    struct page_t* inode_next;
+    struct page_t* lru_prev;
+    struct page_t* lru_next;
+};
+
+struct inode_t {
+    const struct inode_ops_t* ops;
+    void* data;
+    int type;
+    uint32_t size;
+    struct page_t* pages;
+    uint32_t version; // bumped by writes, a page read in across one is stale
+};
+
+struct dentry_t {
+    char name[DENTRY_NAME];
+    struct dentry_t* parent;
+    struct inode_t* inode;
+    struct dentry_t* hash_next;
+};
+
+struct inode_t* alloc_inode(const struct inode_ops_t* ops, void* data, int type, uint32_t size);
+int vfs_mount(const char* path, struct inode_t* root);
+struct inode_t* vfs_lookup(const char* path);
+uint32_t vfs_get_page(struct inode_t* inode, uint32_t index);
+
+struct file_t* vfs_open(const char* path, int flags);
+struct inode_t* file_inode(struct file_t* file);
+
+#endif //VFS_H
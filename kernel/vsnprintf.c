@@ -1,96 +1,239 @@
-#include "stdarg.h"
+#include <stdio.h>
+
+/*
+ * %[-0][width][l|ll]{d,i,u,x,X,p,c,s,%}, width may be *
+ *
+ * the output is always terminated when size > 0, the return value is the
+ * length the whole string would have, like C99.
+ */
+
+#define LEFT  (1 << 0)
+#define ZERO  (1 << 1)
+#define UPPER (1 << 2)
+
+struct output_t {
+    char* buffer;
+    size_t size;
+    size_t count;
+};
+
+static void emit(struct output_t* output, char ch) {
+    if(output->count + 1 < output->size)
+        output->buffer[output->count] = ch;
+
+    output->count++;
+}
+
+// n / 10 with shifts and adds, there is no libgcc for 64 bit division
+static uint64_t divu10(uint64_t n, uint32_t* remainder) {
+    uint64_t q = (n >> 1) + (n >> 2);
+    q += q >> 4;
+    q += q >> 8;
+    q += q >> 16;
+    q += q >> 32;
+    q >>= 3;
+
+    uint32_t r = (uint32_t)(n - ((q << 3) + (q << 1)));
+    if(r > 9) {
+        q++;
+        r -= 10;
+    }
+
+    *remainder = r;
+    return q;
+}
 
-static void itoa(char* buffer, int32_t value) {
-    char* ptr = buffer;
+// digits in reverse order, returns how many
+static int format_decimal(char* buffer, uint64_t value) {
+    int length = 0;
 
-    if(value < 0) {
-        *ptr++ = '-';
-        buffer++;
-        value = -value;
+    while(value >> 32) {
+        uint32_t r;
+        value = divu10(value, &r);
+        buffer[length++] = '0' + r;
     }
 
+    // 0xcccccccd / 2^35 is 1/10 rounded up, exact for every 32 bit value
+    uint32_t low = (uint32_t)value;
     do {
-        int remainder = value % 10;
-        *ptr++ = remainder + '0';
-    } while(value /= 10);
-
-    *ptr = 0;
-
-    char* p1 = buffer;
-    char* p2 = ptr - 1;
-    while(p1 < p2) {
-        char tmp = *p1;
-        *p1 = *p2;
-        *p2 = tmp;
-        p1++;
-        p2--;
-    }
+        uint32_t q = (uint32_t)(((uint64_t)low * 0xcccccccd) >> 35);
+        buffer[length++] = '0' + (low - q * 10);
+        low = q;
+    } while(low);
+
+    return length;
 }
 
-static void uitoa(char* buffer, uint32_t value) {
-    itoa(buffer, value);
+static int format_hex(char* buffer, uint64_t value, int flags) {
+    const char* digits = (flags & UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+    int length = 0;
+
+    do {
+        buffer[length++] = digits[value & 0xf];
+        value >>= 4;
+    } while(value);
+
+    return length;
 }
 
-static void hextoa(char* buffer, uint32_t value) {
-    static const char hex[] = "0123456789abcdef";
-    const char* x = (const char*)&value;
+static void emit_field(struct output_t* output, const char* prefix, const char* digits,
+                       int length, int reversed, int width, int flags) {
+    int prefix_length = 0;
+    while(prefix[prefix_length])
+        prefix_length++;
 
-    for(int i = 3; i >= 0; i--) {
-        char ch = x[i];
-        *buffer++ = hex[(ch >> 4) & 0xf];
-        *buffer++ = hex[ch & 0xf];
-    }
+    int padding = width - length - prefix_length;
+
+    if(!(flags & (LEFT | ZERO)))
+        for(; padding > 0; padding--)
+            emit(output, ' ');
+
+    for(int i = 0; i < prefix_length; i++)
+        emit(output, prefix[i]);
 
-    *buffer = 0;
+    if(flags & ZERO)
+        for(; padding > 0; padding--)
+            emit(output, '0');
+
+    for(int i = 0; i < length; i++)
+        emit(output, reversed ? digits[length - 1 - i] : digits[i]);
+
+    for(; padding > 0; padding--)
+        emit(output, ' ');
 }
 
-int vsnprintf(char* output, size_t size, const char* fmt, va_list va) {
-    char buffer[32];
-    const char* ptr;
+int vsnprintf(char* buffer, size_t size, const char* fmt, va_list va) {
+    struct output_t output = { buffer, size, 0 };
+    char digits[24];
     char ch;
 
-    while((ch = *fmt++) != 0 && size > 0) {
+    while((ch = *fmt++) != 0) {
         if(ch != '%') {
-            *output++ = ch;
+            emit(&output, ch);
             continue;
         }
 
-        ch = *fmt++;
-        switch(ch) {
-            case 'd':
-                itoa(buffer, va_arg(va, int32_t));
-                ptr = buffer;
-                break;
+        int flags = 0;
+        int width = 0;
+        int longs = 0;
 
-            case 'u':
-                uitoa(buffer, va_arg(va, uint32_t));
-                ptr = buffer;
+        for(;; fmt++) {
+            if(*fmt == '-')
+                flags |= LEFT;
+            else if(*fmt == '0')
+                flags |= ZERO;
+            else
                 break;
+        }
 
-            case 'x':
-                hextoa(buffer, va_arg(va, uint32_t));
-                ptr = buffer;
-                break;
+        if(*fmt == '*') {
+            width = va_arg(va, int);
+            if(width < 0) {
+                flags |= LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while(*fmt >= '0' && *fmt <= '9')
+                width = width * 10 + (*fmt++ - '0');
+        }
 
-            case 's':
-                ptr = va_arg(va, const char*);
-                if(!ptr) ptr = "(null)";
-                break;
+        while(*fmt == 'l') {
+            longs++;
+            fmt++;
+        }
 
-            default:
-                buffer[0] = 0;
-                ptr = buffer;
-                break;
+        if(flags & LEFT)
+            flags &= ~ZERO;
+
+        uint64_t value;
+        const char* prefix = "";
+        int length;
+
+        switch(ch = *fmt++) {
+        case 'd':
+        case 'i': {
+            int64_t number = longs > 1 ? va_arg(va, int64_t) : va_arg(va, int32_t);
+
+            if(number < 0) {
+                prefix = "-";
+                value = -(uint64_t)number;
+            } else {
+                value = number;
+            }
+
+            length = format_decimal(digits, value);
+            emit_field(&output, prefix, digits, length, 1, width, flags);
+            break;
+        }
+
+        case 'u':
+            value = longs > 1 ? va_arg(va, uint64_t) : va_arg(va, uint32_t);
+            length = format_decimal(digits, value);
+            emit_field(&output, prefix, digits, length, 1, width, flags);
+            break;
+
+        case 'X':
+            flags |= UPPER;
+            // fall through
+        case 'x':
+            value = longs > 1 ? va_arg(va, uint64_t) : va_arg(va, uint32_t);
+            length = format_hex(digits, value, flags);
+            emit_field(&output, prefix, digits, length, 1, width, flags);
+            break;
+
+        case 'p':
+            value = (uint32_t)va_arg(va, void*);
+            length = format_hex(digits, value, flags);
+            while(length < 8)
+                digits[length++] = '0';
+            emit_field(&output, "0x", digits, length, 1, width, flags & ~ZERO);
+            break;
+
+        case 'c':
+            digits[0] = (char)va_arg(va, int);
+            emit_field(&output, prefix, digits, 1, 0, width, flags & ~ZERO);
+            break;
+
+        case 's': {
+            const char* string = va_arg(va, const char*);
+            if(!string) string = "(null)";
+
+            for(length = 0; string[length]; length++)
+                ;
+
+            emit_field(&output, prefix, string, length, 0, width, flags & ~ZERO);
+            break;
         }
 
-        while(*ptr && size > 0) {
-            *output++ = *ptr++;
-            size--;
+        case '%':
+            emit(&output, '%');
+            break;
+
+        case 0:
+            fmt--;
+            break;
+
+        default:
+            emit(&output, '%');
+            emit(&output, ch);
+            break;
         }
     }
 
-    *output = 0;
+    if(size > 0)
+        buffer[output.count < size ? output.count : size - 1] = 0;
 
-    return 0;
+    return output.count;
 }
 
+int snprintf(char* buffer, size_t size, const char* fmt, ...) {
+    va_list va;
+    int ret;
+
+    va_start(va, fmt);
+    ret = vsnprintf(buffer, size, fmt, va);
+    va_end(va);
+
+    return ret;
+}
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+# symbolize a profiler dump (SYSTEM_profile, PROFILE_DUMP) from a serial log
+#
+#   tools/profile.py serial.log                 flat profile per function
+#   tools/profile.py -l serial.log              per source line (addr2line)
+#   tools/profile.py --folded serial.log        call chains, folded stacks
+#
+# the dump format is described in kernel/profile.c
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+def parse(lines):
+    header = None
+    hits = {}
+    chains = []
+
+    for line in lines:
+        fields = line.split()
+
+        if not fields:
+            continue
+        if fields[0] == 'profile' and len(fields) == 5:
+            header = [int(x, 16) for x in fields[1:]]
+            hits = {}
+            chains = []
+        elif header is None:
+            continue
+        elif fields[0] == 'end':
+            break
+        elif fields[0] == 'chain':
+            chains.append([int(x, 16) for x in fields[1:]])
+        elif len(fields) == 2:
+            hits[int(fields[0], 16)] = int(fields[1], 16)
+
+    return header, hits, chains
+
+
+class Symbols:
+    def __init__(self, elf):
+        output = subprocess.run(['nm', '-n', '--defined-only', elf],
+                                capture_output=True, text=True, check=True).stdout
+        self.addresses = []
+        self.names = []
+
+        for line in output.splitlines():
+            fields = line.split()
+            if len(fields) == 3 and fields[1] in 'tT':
+                self.addresses.append(int(fields[0], 16))
+                self.names.append(fields[2])
+
+    def lookup(self, address):
+        i = bisect.bisect_right(self.addresses, address) - 1
+        return self.names[i] if i >= 0 else '%#x' % address
+
+
+def lines(elf, addresses):
+    output = subprocess.run(['addr2line', '-e', elf] + ['%#x' % a for a in addresses],
+                            capture_output=True, text=True, check=True).stdout
+    return output.splitlines()
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('log', nargs='?')
+    parser.add_argument('-e', '--elf', default='bin/kernel.elf')
+    parser.add_argument('-l', '--lines', action='store_true')
+    parser.add_argument('--folded', action='store_true')
+    args = parser.parse_args()
+
+    log = open(args.log, errors='replace') if args.log else sys.stdin
+    header, hits, chains = parse(log)
+
+    if header is None:
+        print('no profile found', file=sys.stderr)
+        return 1
+
+    symbols = Symbols(args.elf)
+    _, _, samples, user = header
+
+    if args.folded:
+        stacks = collections.Counter()
+        for chain in chains:
+            stacks[';'.join(symbols.lookup(a) for a in reversed(chain))] += 1
+        for stack, count in stacks.most_common():
+            print(stack, count)
+        return 0
+
+    totals = collections.Counter()
+    if args.lines:
+        addresses = sorted(hits)
+        for address, where in zip(addresses, lines(args.elf, addresses)):
+            totals['%s %s' % (symbols.lookup(address), where)] += hits[address]
+    else:
+        for address, count in hits.items():
+            totals[symbols.lookup(address)] += count
+
+    print('%d samples, %d in user mode' % (samples, user))
+    for name, count in totals.most_common():
+        print('%6.2f%% %8d  %s' % (100.0 * count / max(samples, 1), count, name))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+#
+# decode a trace dump (SYSTEM_trace, TRACE_DUMP) from a serial log, e.g.
+#
+#   qemu-system-i386 -fda iso/boot.img -serial file:serial.log
+#   tools/tracedump.py serial.log
+#
+# the record layout and event ids follow kernel/trace.h
+
+import struct
+import sys
+
+RECORD = struct.Struct('<QHHI4I')
+
+EVENTS = {
+    1: ('schedule',   lambda a: 'pid %d -> %d' % (a[0], a[1])),
+    2: ('interrupt',  lambda a: 'vector %d error %#x eip %#010x' % (a[0], a[1], a[2])),
+    3: ('irq',        lambda a: 'vector %d eip %#010x' % (a[0], a[1])),
+    4: ('syscall',    lambda a: 'nr %d args %#x %#x %#x' % tuple(a[:4])),
+    5: ('heap_alloc', lambda a: 'size %d align %d -> %#010x' % (a[0], a[1], a[2])),
+    6: ('page_fault', lambda a: 'address %#010x error %#x eip %#010x' % (a[0], a[1], a[2])),
+}
+
+
+def parse(lines):
+    records = []
+    expected = 0
+
+    for line in lines:
+        line = line.strip()
+
+        if line.startswith('trace '):
+            _, cpu, count = line.split()
+            expected = int(count, 16)
+        elif line == 'end':
+            expected = 0
+        elif expected > 0:
+            try:
+                data = bytes.fromhex(line)
+            except ValueError:
+                continue
+            if len(data) != RECORD.size:
+                continue
+            tsc, event, cpu, pid, *args = RECORD.unpack(data)
+            records.append((tsc, event, cpu, pid, args))
+            expected -= 1
+
+    return records
+
+
+def main():
+    lines = open(sys.argv[1], errors='replace') if len(sys.argv) > 1 else sys.stdin
+    records = sorted(parse(lines))
+
+    if not records:
+        print('no trace records found', file=sys.stderr)
+        return 1
+
+    start = records[0][0]
+    previous = start
+
+    for tsc, event, cpu, pid, args in records:
+        name, describe = EVENTS.get(event, ('event %d' % event, lambda a: ' '.join('%#x' % x for x in a)))
+        print('%14d %+10d cpu%d pid %-3d %-10s %s' % (tsc - start, tsc - previous, cpu, pid, name, describe(args)))
+        previous = tsc
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
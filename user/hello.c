@@ -0,0 +1,33 @@
+#include <stdint.h>
+
+#include "syscall.h"
+
+/*
+ * the first ring 3 program, exec builds a call frame for _start on the
+ * stack. There is no libc, system calls go straight through syscall.h
+ */
+
+static char greeting[] = "hello";
+static int calls; // in .bss
+
+static void print(const char* text) {
+    size_t length = 0;
+
+    while(text[length])
+        length++;
+
+    syscall(SYSTEM_write, 1, (uint32_t)text, length);
+    calls++;
+}
+
+void _start(int argc, char** argv) {
+    print(greeting);
+
+    for(int i = 1; i < argc; i++) {
+        print(" ");
+        print(argv[i]);
+    }
+
+    print("\n");
+    syscall(SYSTEM_exit, calls, 0, 0);
+}